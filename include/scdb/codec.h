@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+#include "scdb/string_piece.h"
+
+namespace scdb {
+
+// Compress and uncompress a single value of a map.
+// A codec is identified by its registry id, the id is stored in file header
+// as Writer::Option::compress_type, so reader can find the same codec.
+class Codec
+{
+public:
+    virtual ~Codec() {}
+
+    // Return false if [v] can not be compressed, the value will be stored raw
+    virtual bool Compress(const StringPiece& v, std::string* cv) const = 0;
+
+    // Return false if [cv] is corrupted
+    virtual bool Uncompress(const StringPiece& cv, std::string* v) const = 0;
+};
+
+// [level] 0 means default level of the codec, [dict] is empty if no dictionary
+typedef Codec* (*CodecFactory)(int level, const StringPiece& dict);
+
+// Register a codec for [id] of 0 to 127, return false if [id] is out of
+// range or already taken.
+// Not thread safe, register before any Writer or Reader created.
+bool RegisterCodec(int id, const std::string& name, CodecFactory factory);
+
+// Create codec registered with [id], NULL if no such codec
+Codec* NewCodec(int id, int level, const StringPiece& dict = StringPiece());
+
+// Name of codec registered with [id], empty if no such codec
+std::string CodecName(int id);
+
+} // namespace
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
 #include <vector>
+#include <algorithm>
 #include <stdexcept>
+#include <functional>
 
 #include "scdb/string_piece.h"
 
@@ -13,10 +19,12 @@ public:
     struct Option
     {
         Option()
-            : mmap_preload(false)
+            : mmap_preload(false),
+              block_cache_size(32 << 20)
         {}
 
         bool mmap_preload;
+        size_t block_cache_size; // bytes of uncompressed blocks cached, for file built with block_size
     };
 
     virtual ~Reader() {}
@@ -24,17 +32,115 @@ public:
     // whether [key] exist
     virtual bool Exist(const StringPiece& key) const = 0; 
 
-    // Get the value of [key](iff build with value)
+    // Get the value of [key](iff build with value). For kDFA, compressed, block
+    // and inline values the value is restored into a buffer of the calling
+    // thread shared by all readers, valid until the next call on any reader
+    // on this thread. Use GetAsString to keep it longer
     virtual StringPiece Get(const StringPiece& key) const = 0; 
 
     // for uncompressed values of [key], more copy and uncompress time than Get
     virtual std::string GetAsString(const StringPiece& key) const = 0; 
 
+    // Uncompressed values of [keys] into [values], empty for a missing key
+    virtual void MultiGetAsString(const StringPiece* keys, size_t n, std::vector<std::string>* values) const
+    {
+        values->resize(n);
+        for (size_t i = 0;i < n; i++)
+        {
+            (*values)[i] = GetAsString(keys[i]);
+        }
+    }
+
+    // Keys have dense ids in [0, size()), callers may index their own
+    // arrays by id instead of looking keys up again
+    virtual size_t size() const
+    {
+        throw std::runtime_error("Not Implemented");
+    }
+
+    // Return false if [key] is missing
+    virtual bool LookupId(const StringPiece& key, uint64_t* id) const
+    {
+        throw std::runtime_error("Not Implemented");
+    }
+
+    // Key and uncompressed value of [id], throw std::out_of_range if id >= size()
+    virtual std::string KeyById(uint64_t id) const
+    {
+        throw std::runtime_error("Not Implemented");
+    }
+
+    virtual std::string GetById(uint64_t id) const
+    {
+        throw std::runtime_error("Not Implemented");
+    }
+
+    // Copy values of [keys] to [out] + i * [stride], a value longer than
+    // stride is truncated, a shorter one or a missing key is zero filled.
+    // For fixed width values, e.g. embeddings gathered into a matrix
+    virtual void GatherValues(const StringPiece* keys, size_t n, char* out, size_t stride, bool* found) const
+    {
+        for (size_t i = 0;i < n; i++)
+        {
+            auto v = GetAsString(keys[i]);
+            found[i] = !v.empty() || Exist(keys[i]);
+
+            auto length = std::min(v.length(), stride);
+            memcpy(out + i * stride, v.data(), length);
+            memset(out + i * stride + length, 0, stride - length);
+        }
+    }
+
+    // Value of [key] of a kIntMap file, return false if [key] is missing
+    virtual bool GetInt(const StringPiece& key, uint64_t* value) const
+    {
+        throw std::runtime_error("Not Implemented");
+    }
+
+    // Values of [keys] of a kIntMap file, [found] is false and value 0 for a missing key
+    virtual void MultiGetInt(const StringPiece* keys, size_t n, uint64_t* values, bool* found) const
+    {
+        for (size_t i = 0;i < n; i++)
+        {
+            found[i] = GetInt(keys[i], &values[i]);
+            if (!found[i])
+                values[i] = 0;
+        }
+    }
+
     // Get uncomressed values of prefix, more copy and uncomressed time than PrefixGet
     virtual std::vector<std::pair<std::string, std::string>> PrefixGet(const StringPiece& prefix, size_t count) const
     {
         throw std::runtime_error("Not Implemented");
     }
+
+    // Number of keys of [prefix], a file built with key order answers it
+    // without visiting the keys
+    virtual uint64_t CountPrefix(const StringPiece& prefix) const
+    {
+        uint64_t n = 0;
+        PrefixScan(prefix, [&n](const StringPiece&, const std::string&) {
+            n++;
+            return true;
+        });
+        return n;
+    }
+
+    // At most [k] keys of [prefix] with the largest weights given by
+    // Writer::PutWeighted, heaviest first
+    virtual std::vector<std::pair<std::string, float>> TopKPrefix(const StringPiece& prefix, size_t k) const
+    {
+        throw std::runtime_error("Not Implemented");
+    }
+
+    // return false to stop scan
+    typedef std::function<bool(const StringPiece& key, const std::string& value)> Visitor;
+
+    // Visit all keys of [prefix] with uncompressed values, without collecting them
+    virtual void PrefixScan(const StringPiece& prefix, const Visitor& visitor) const
+    {
+        throw std::runtime_error("Not Implemented");
+    }
 };
 
 } // namespace
@@ -1,12 +1,43 @@
 #pragma once
 
+#include <vector>
+
 #include "scdb/reader.h"
 #include "scdb/writer.h"
 
 namespace scdb {
 
+// [name] is a file or manifest of a sharded dataset
 Reader* CreateReader(const Reader::Option& option, const std::string& name);
 
 Writer* CreateWriter(const Writer::Option& option, const std::string& name);
 
+// Build a delta of upserts by Put() and tombstones by Delete() to overlay a base
+// built with [option]. Values of a delta are never laid out by width, inline,
+// in blocks or deduplicated; a kIntMap base has no delta
+Writer* CreateDeltaWriter(const Writer::Option& option, const std::string& name);
+
+// Read [base] overlaid by [deltas], the last delta is the newest.
+// [base] may be empty if all keys are in deltas, NULL for a kIntMap base
+Reader* CreateLayeredReader(const Reader::Option& option, const std::string& base, const std::vector<std::string>& deltas);
+
+// Fold [deltas] into [base], write a new base to [output]
+bool CompactLayers(const Writer::Option& option, const std::string& base, const std::vector<std::string>& deltas, const std::string& output);
+
+// Which value is kept when a key is in more than one input of Merge()
+enum MergePolicy
+{
+    kFirstWins = 0,
+    kLastWins = 1,
+};
+
+// Merge [inputs] into one file [output] built with [option]. Values are
+// copied without uncompress when an input has the same compress type.
+// Keys of an input are streamed in byte order from its key order section
+// if built with_key_order, else from sorted runs of spool_memory_limit
+// bytes spilled to temp_folder. The output takes them as sorted input, so
+// only its key trie, built at Close like any file, holds all keys at once;
+// a kDFA output buffers keys as without sorted input
+bool Merge(const Writer::Option& option, const std::vector<std::string>& inputs, const std::string& output, MergePolicy policy);
+
 } // namespace
@@ -1,23 +1,125 @@
 #pragma once
 
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <functional>
+
 #include "scdb/string_piece.h"
 
 namespace scdb {
 
+// Measurements of a build, returned by Writer::Close()
+struct BuildStats
+{
+    // Put, or a step of Close
+    struct Phase
+    {
+        Phase()
+            : micros(0),
+              bytes(0),
+              peak_rss(0),
+              peak_rss_growth(0)
+        {}
+
+        std::string name; // put, layout, dictionary, key_trie, value_trie, pfd, merge, checksum
+        int64_t micros;
+        int64_t bytes; // bytes written by the phase
+        int64_t peak_rss; // peak resident bytes of the process by the end of the phase, 0 if unknown
+        int64_t peak_rss_growth; // bytes the peak rose during the phase, other builds of the process count too
+    };
+
+    BuildStats()
+        : num_records(0),
+          value_bytes(0),
+          data_bytes(0),
+          file_bytes(0),
+          peak_staging_bytes(0)
+    {}
+
+    const Phase* FindPhase(const std::string& name) const
+    {
+        for (auto& phase : phases)
+        {
+            if (phase.name == name)
+                return &phase;
+        }
+        return NULL;
+    }
+
+    double RecordsPerSecond() const
+    {
+        auto put = FindPhase("put");
+        return put && put->micros > 0 ? num_records * 1e6 / put->micros : 0;
+    }
+
+    // bytes of values Put over bytes of the data section
+    double CompressionRatio() const
+    {
+        return data_bytes > 0 ? static_cast<double>(value_bytes) / data_bytes : 0;
+    }
+
+    // peak staging bytes over records Put
+    double StagingBytesPerRecord() const
+    {
+        return num_records > 0 ? static_cast<double>(peak_staging_bytes) / num_records : 0;
+    }
+
+    int64_t num_records;
+    int64_t value_bytes;
+    int64_t data_bytes;
+    int64_t file_bytes;
+    int64_t peak_staging_bytes; // heap bytes held for the build before Close, sampled after each record Put
+    std::vector<Phase> phases; // in order of run
+};
+
 class Writer
 {
 public:
+    // Besides kNone and kDFA, a compress type is the registry id of a Codec,
+    // see scdb/codec.h to register more
     enum CompressType
     {
         kNone = 0,
         kSnappy = 1,
-        kDFA = 2
+        kDFA = 2,
+        kZstdDict = 3, // zstd with a dictionary trained from values
+        kLZ4 = 4,
+        kZstd = 5
     };
 
     enum BuildType
     {
         kMap = 0,
         kSet = 1,
+        kIntMap = 2, // uint64 values kept in the offset index, no data section
+    };
+
+    // Configuration of marisa tries, a default value leaves it to marisa
+    enum TrieCacheLevel
+    {
+        kDefaultCache = 0,
+        kHugeCache = 1,
+        kLargeCache = 2,
+        kNormalCache = 3,
+        kSmallCache = 4,
+        kTinyCache = 5
+    };
+
+    enum TrieTailMode
+    {
+        kDefaultTail = 0,
+        kTextTail = 1,
+        kBinaryTail = 2
+    };
+
+    enum TrieNodeOrder
+    {
+        kDefaultOrder = 0,
+        kLabelOrder = 1,
+        kWeightOrder = 2
     };
 
     struct Option
@@ -25,13 +127,32 @@ public:
         Option()
             : temp_folder("./tmp"),
               compress_type(kNone),
+              compress_level(0),
               build_type(kMap),
-              with_checksum(false)
+              with_checksum(false),
+              dedup_values(false),
+              dedup_memory_limit(256 << 20),
+              zstd_dict_size(112640),
+              block_size(0),
+              sorted_input(false),
+              num_shards(1),
+              spool_memory_limit(32 << 20),
+              progress_interval(1 << 20),
+              trie_num_tries(0),
+              trie_cache_level(kDefaultCache),
+              trie_tail_mode(kDefaultTail),
+              trie_node_order(kDefaultOrder),
+              trie_auto_tune(false),
+              trie_tune_sample(100000),
+              value_width(0),
+              with_key_order(false),
+              inline_value_bytes(0)
         {}
 
+        // set has no value
         bool IsNoDataSection() const
         {
-            if (build_type == 1)
+            if (build_type == kSet)
                 return true;
 
             return false;
@@ -39,8 +160,27 @@ public:
 
         std::string temp_folder;
         CompressType compress_type;
+        int compress_level; // 0 is default level of codec, for lz4 > 0 means lz4hc
         BuildType build_type;
         bool with_checksum; // a checksum attached at endof file, will check when reader load
+        bool dedup_values; // store each distinct value once across all key lengths
+        size_t dedup_memory_limit; // max bytes of the value hash table, stop remembering new values beyond it
+        size_t zstd_dict_size; // max bytes of the trained dictionary for kZstdDict
+        size_t block_size; // > 0 compress values in blocks of about block_size bytes in key id order, Get() uncompresses into a thread buffer then
+        bool sorted_input; // keys are Put in ascending order, Put() throws std::invalid_argument otherwise. Keys spill to disk during Put only, Close loads them all back to build the trie
+        int num_shards; // > 1 partition keys by hash into num_shards files built in parallel, the output is their manifest
+        size_t spool_memory_limit; // max bytes of values buffered for all key lengths, beyond it the largest buffer is spilled to one temp file
+        std::function<void(const BuildStats&)> progress; // if set, called every progress_interval records Put and after each phase of Close
+        int64_t progress_interval;
+        int trie_num_tries; // 1 to 127, 0 is default of marisa(3), more tries smaller but slower
+        TrieCacheLevel trie_cache_level; // larger cache faster lookup but bigger trie
+        TrieTailMode trie_tail_mode;
+        TrieNodeOrder trie_node_order;
+        bool trie_auto_tune; // try num_tries and cache levels on a sample of keys, pick the smallest size * lookup time
+        size_t trie_tune_sample; // max keys sampled to auto tune
+        int value_width; // > 0 every value is value_width bytes, laid out by key id without pfd, -1 do so if all values have the same length. kNone only
+        bool with_key_order; // keep key ids in key order for CountPrefix, FuzzySearch and Merge, 4 bytes a key, always kept with weights
+        int inline_value_bytes; // 1 to 7, values of at most these bytes are kept in their pfd entries if no wider than the widest offset entry, decided at Close so the layout does not depend on input order. They are staged in data section all the same, a Get of them touches no data
     };
 
     virtual ~Writer() {}
@@ -51,8 +191,40 @@ public:
     // Build k-v 
     virtual void Put(const StringPiece& k, const StringPiece& v) = 0;
 
-    // Generate final output
-    virtual void Close() = 0;
+    // Build k-v of kIntMap, Put(k, v) of kIntMap takes v in decimal
+    virtual void PutInt(const StringPiece& k, uint64_t v)
+    {
+        throw std::runtime_error("Not Implemented");
+    }
+
+    // Build k-v(only k of a set) with a weight for TopKPrefix of reader, a
+    // key put without weight weighs 0. The weight also guides kWeightOrder
+    virtual void PutWeighted(const StringPiece& k, const StringPiece& v, float weight)
+    {
+        throw std::runtime_error("Not Implemented");
+    }
+
+    // Build n records at once, [values] is NULL to build only keys.
+    // Same result as calling Put() in order, but cheaper per record
+    virtual void PutBatch(const StringPiece* keys, const StringPiece* values, size_t n)
+    {
+        for (size_t i = 0;i < n; i++)
+        {
+            if (values)
+                Put(keys[i], values[i]);
+            else
+                Put(keys[i]);
+        }
+    }
+
+    // Remove k, only a delta writer can build a tombstone
+    virtual void Delete(const StringPiece& k)
+    {
+        throw std::runtime_error("Not Implemented");
+    }
+
+    // Generate final output, calling it again returns the same stats
+    virtual BuildStats Close() = 0;
 };
 
 } // namespace
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include <boost/noncopyable.hpp>
+
+#include "scdb/string_piece.h"
+
+#include "utils/varint.h"
+
+namespace scdb {
+
+// An uncompressed block of values, a value is addressed by its slot
+class ValueBlock : boost::noncopyable
+{
+public:
+    // [data] is sequence of varint length prefixed values
+    explicit ValueBlock(std::string* data)
+    {
+        data_.swap(*data);
+
+        auto begin = reinterpret_cast<const int8_t*>(data_.data());
+        auto end = begin + data_.length();
+        for (auto p = begin; p < end; )
+        {
+            size_t prefix_length;
+            auto value_length = DecodeVarint(p, end, &prefix_length);
+            slots_.push_back(p + prefix_length - begin);
+            lengths_.push_back(value_length);
+            p += prefix_length + value_length;
+        }
+    }
+
+    size_t num_slots() const { return slots_.size(); }
+
+    StringPiece Value(size_t slot) const
+    {
+        if (slot >= slots_.size())
+            return StringPiece();
+        return StringPiece(data_.data() + slots_[slot], lengths_[slot]);
+    }
+
+    size_t charge() const
+    {
+        return data_.capacity() + (slots_.capacity() + lengths_.capacity()) * sizeof(uint32_t);
+    }
+
+private:
+    std::string data_;
+    std::vector<uint32_t> slots_;
+    std::vector<uint32_t> lengths_;
+};
+
+// Sharded LRU cache of uncompressed blocks, thread safe
+class BlockCache : boost::noncopyable
+{
+public:
+    typedef std::shared_ptr<const ValueBlock> BlockPtr;
+
+    explicit BlockCache(size_t capacity)
+        : shards_(kNumShards)
+    {
+        for (auto& shard : shards_)
+        {
+            shard.capacity = capacity / kNumShards;
+            shard.charge = 0;
+        }
+    }
+
+    // Return NULL if [block] not cached
+    BlockPtr Lookup(uint64_t block)
+    {
+        auto& shard = GetShard(block);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.index.find(block);
+        if (it == shard.index.end())
+            return BlockPtr();
+
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return it->second->second;
+    }
+
+    void Insert(uint64_t block, const BlockPtr& value)
+    {
+        auto& shard = GetShard(block);
+        if (shard.capacity == 0)
+            return ;
+
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.index.count(block))
+            return ;
+
+        shard.lru.push_front(std::make_pair(block, value));
+        shard.index[block] = shard.lru.begin();
+        shard.charge += value->charge();
+
+        while (shard.charge > shard.capacity && shard.lru.size() > 1)
+        {
+            auto& last = shard.lru.back();
+            shard.charge -= last.second->charge();
+            shard.index.erase(last.first);
+            shard.lru.pop_back();
+        }
+    }
+
+private:
+    static const size_t kNumShards = 16;
+
+    typedef std::list<std::pair<uint64_t, BlockPtr>> LRUList;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        LRUList lru;
+        std::unordered_map<uint64_t, LRUList::iterator> index;
+        size_t capacity;
+        size_t charge;
+    };
+
+    Shard& GetShard(uint64_t block)
+    {
+        return shards_[block % kNumShards];
+    }
+
+    std::vector<Shard> shards_;
+};
+
+} // namespace
@@ -0,0 +1,252 @@
+#include "scdb/codec.h"
+
+#include <limits>
+#include <vector>
+
+#include <lz4.h>
+#include <lz4hc.h>
+#include <zstd.h>
+#include <snappy.h>
+#include <glog/logging.h>
+
+#include "scdb/writer.h"
+
+#include "utils/varint.h"
+
+namespace scdb {
+
+namespace {
+
+class SnappyCodec : public Codec
+{
+public:
+    virtual bool Compress(const StringPiece& v, std::string* cv) const
+    {
+        snappy::Compress(v.data(), v.length(), cv);
+        return true;
+    }
+
+    virtual bool Uncompress(const StringPiece& cv, std::string* v) const
+    {
+        return snappy::Uncompress(cv.data(), cv.length(), v);
+    }
+
+    static Codec* New(int, const StringPiece&)
+    {
+        return new SnappyCodec();
+    }
+};
+
+// lz4 block format does not keep the raw length, prefix it as varint
+class LZ4Codec : public Codec
+{
+public:
+    LZ4Codec(int level)
+        : level_(level)
+    {}
+
+    virtual bool Compress(const StringPiece& v, std::string* cv) const
+    {
+        uint8_t prefix[kMaxVarintLength64];
+        auto prefix_length = EncodeVarint(v.length(), prefix);
+
+        auto bound = LZ4_compressBound(v.length());
+        cv->resize(prefix_length + bound);
+        memcpy(&(*cv)[0], prefix, prefix_length);
+
+        auto dst = &(*cv)[prefix_length];
+        auto n = level_ > 0 ? LZ4_compress_HC(v.data(), dst, v.length(), bound, level_)
+                            : LZ4_compress_default(v.data(), dst, v.length(), bound);
+        if (n <= 0)
+            return false;
+
+        cv->resize(prefix_length + n);
+        return true;
+    }
+
+    virtual bool Uncompress(const StringPiece& cv, std::string* v) const
+    {
+        auto begin = reinterpret_cast<const int8_t*>(cv.data());
+        size_t prefix_length = 0;
+        uint64_t length = 0;
+        try
+        {
+            length = DecodeVarint(begin, begin + cv.length(), &prefix_length);
+        }
+        catch (const std::invalid_argument&)
+        {
+            return false;
+        }
+
+        v->resize(length);
+        if (length == 0)
+            return true;
+
+        auto n = LZ4_decompress_safe(cv.data() + prefix_length, &(*v)[0], cv.length() - prefix_length, length);
+        return n == static_cast<int>(length);
+    }
+
+    static Codec* New(int level, const StringPiece&)
+    {
+        return new LZ4Codec(level);
+    }
+
+private:
+    int level_; // > 0 use lz4hc
+};
+
+// zstd contexts are not thread safe, keep one pair per thread for all codecs
+class ZstdThreadContext
+{
+public:
+    ZstdThreadContext()
+        : cctx_(ZSTD_createCCtx()),
+          dctx_(ZSTD_createDCtx())
+    {}
+
+    ~ZstdThreadContext()
+    {
+        ZSTD_freeCCtx(cctx_);
+        ZSTD_freeDCtx(dctx_);
+    }
+
+    static ZstdThreadContext& Get()
+    {
+        static thread_local ZstdThreadContext context;
+        return context;
+    }
+
+    ZSTD_CCtx* cctx() { return cctx_; }
+    ZSTD_DCtx* dctx() { return dctx_; }
+
+private:
+    ZSTD_CCtx* cctx_;
+    ZSTD_DCtx* dctx_;
+};
+
+class ZstdCodec : public Codec
+{
+public:
+    ZstdCodec(int level, const StringPiece& dict)
+        : level_(level > 0 ? level : ZSTD_CLEVEL_DEFAULT),
+          cdict_(NULL),
+          ddict_(NULL)
+    {
+        if (!dict.empty())
+        {
+            cdict_ = ZSTD_createCDict(dict.data(), dict.length(), level_);
+            ddict_ = ZSTD_createDDict(dict.data(), dict.length());
+            CHECK(cdict_ && ddict_) << "bad zstd dictionary";
+        }
+    }
+
+    virtual ~ZstdCodec()
+    {
+        ZSTD_freeCDict(cdict_);
+        ZSTD_freeDDict(ddict_);
+    }
+
+    virtual bool Compress(const StringPiece& v, std::string* cv) const
+    {
+        auto cctx = ZstdThreadContext::Get().cctx();
+        cv->resize(ZSTD_compressBound(v.length()));
+        auto n = cdict_ ? ZSTD_compress_usingCDict(cctx, &(*cv)[0], cv->size(), v.data(), v.length(), cdict_)
+                        : ZSTD_compressCCtx(cctx, &(*cv)[0], cv->size(), v.data(), v.length(), level_);
+        if (ZSTD_isError(n))
+        {
+            LOG(ERROR) << "zstd compress failed: " << ZSTD_getErrorName(n);
+            return false;
+        }
+
+        cv->resize(n);
+        return true;
+    }
+
+    virtual bool Uncompress(const StringPiece& cv, std::string* v) const
+    {
+        auto size = ZSTD_getFrameContentSize(cv.data(), cv.length());
+        if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN)
+            return false;
+
+        v->resize(size);
+        if (size == 0)
+            return true;
+
+        auto dctx = ZstdThreadContext::Get().dctx();
+        auto n = ddict_ ? ZSTD_decompress_usingDDict(dctx, &(*v)[0], size, cv.data(), cv.length(), ddict_)
+                        : ZSTD_decompressDCtx(dctx, &(*v)[0], size, cv.data(), cv.length());
+        return !ZSTD_isError(n) && n == size;
+    }
+
+    static Codec* New(int level, const StringPiece& dict)
+    {
+        return new ZstdCodec(level, dict);
+    }
+
+private:
+    int level_;
+    ZSTD_CDict* cdict_;
+    ZSTD_DDict* ddict_; // pre-digested, shared by threads
+};
+
+struct CodecEntry
+{
+    int id;
+    std::string name;
+    CodecFactory factory;
+};
+
+std::vector<CodecEntry>& Registry()
+{
+    static std::vector<CodecEntry> registry = {
+        { Writer::kSnappy, "snappy", &SnappyCodec::New },
+        { Writer::kZstdDict, "zstd-dict", &ZstdCodec::New },
+        { Writer::kLZ4, "lz4", &LZ4Codec::New },
+        { Writer::kZstd, "zstd", &ZstdCodec::New },
+    };
+    return registry;
+}
+
+const CodecEntry* FindCodec(int id)
+{
+    for (auto& entry : Registry())
+    {
+        if (entry.id == id)
+            return &entry;
+    }
+    return NULL;
+}
+
+} // namespace
+
+bool RegisterCodec(int id, const std::string& name, CodecFactory factory)
+{
+    // the id is kept as an int8 in the file header
+    if (id < 0 || id > std::numeric_limits<int8_t>::max())
+        return false;
+
+    if (FindCodec(id) || id == Writer::kNone || id == Writer::kDFA)
+        return false;
+
+    CodecEntry entry = { id, name, factory };
+    Registry().push_back(entry);
+    return true;
+}
+
+Codec* NewCodec(int id, int level, const StringPiece& dict)
+{
+    auto entry = FindCodec(id);
+    if (!entry)
+        return NULL;
+    return entry->factory(level, dict);
+}
+
+std::string CodecName(int id)
+{
+    auto entry = FindCodec(id);
+    if (!entry)
+        return "";
+    return entry->name;
+}
+
+} // namespace
@@ -0,0 +1,65 @@
+#include "delta_writer.h"
+
+#include <stdexcept>
+
+#include "format.h"
+#include "marisa-trie_writer.h"
+
+namespace scdb {
+
+namespace {
+
+// Tagged values of any length are one by one, options of the base on
+// the layout of its values are reset
+Writer::Option DeltaOption(const Writer::Option& option)
+{
+    if (option.build_type == Writer::kIntMap)
+    {
+        throw std::invalid_argument("delta of kIntMap is not supported");
+    }
+
+    Writer::Option defaults;
+    Writer::Option delta_option(option);
+    delta_option.build_type = Writer::kMap;
+    delta_option.value_width = defaults.value_width;
+    delta_option.inline_value_bytes = defaults.inline_value_bytes;
+    delta_option.block_size = defaults.block_size;
+    delta_option.dedup_values = defaults.dedup_values;
+    return delta_option;
+}
+
+} // namespace
+
+DeltaWriter::DeltaWriter(const Writer::Option& option, const std::string& fname)
+    : writer_(new MarisaTrieWriter(DeltaOption(option), fname))
+{
+}
+
+DeltaWriter::~DeltaWriter()
+{
+}
+
+void DeltaWriter::Put(const StringPiece& k)
+{
+    Put(k, StringPiece());
+}
+
+void DeltaWriter::Put(const StringPiece& k, const StringPiece& v)
+{
+    buf_.assign(1, static_cast<char>(kDeltaUpsert));
+    v.AppendToString(&buf_);
+    writer_->Put(k, buf_);
+}
+
+void DeltaWriter::Delete(const StringPiece& k)
+{
+    buf_.assign(1, static_cast<char>(kDeltaTombstone));
+    writer_->Put(k, buf_);
+}
+
+BuildStats DeltaWriter::Close()
+{
+    return writer_->Close();
+}
+
+} // namespace
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "scdb/writer.h"
+
+#include <string>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace scdb {
+
+// A delta is a map whose values are tagged by DeltaTag, built by a
+// MarisaTrieWriter. It keeps the options of the base but those laying
+// values out by width, inline, in blocks or deduplicated. A kIntMap base
+// has no delta
+class DeltaWriter : boost::noncopyable,
+                    public Writer
+{
+public:
+    DeltaWriter(const Writer::Option& option, const std::string& fname);
+    virtual ~DeltaWriter();
+
+    // upsert k with empty value, for delta of a set
+    virtual void Put(const StringPiece& k);
+    virtual void Put(const StringPiece& k, const StringPiece& v);
+    virtual void Delete(const StringPiece& k);
+    virtual BuildStats Close();
+
+private:
+    boost::scoped_ptr<Writer> writer_;
+    std::string buf_;
+};
+
+} // namespace
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <ctype.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <string>
+
+#include <farmhash.h>
+
+#include "scdb/string_piece.h"
+
+namespace scdb {
+
+// File starts with a version tag "SCDBV<n>." written by MarisaTrieWriter
+//   V1: initial format
+//   V2: a layout of data section follows writer option, pfd and key trie
+//       offsets are int64 and followed by offset of key order section,
+//       length prefix of a compressed value keep a raw flag at lowest bit
+const int kFormatVersion = 2;
+const size_t kVersionTagLength = 7;
+const size_t kMaxVersionTagLength = 16;
+
+// How values are laid out in data section of a map
+enum DataLayout
+{
+    // grouped by key length, pfd keep offset of a value in its group
+    kPerLengthLayout = 0,
+    // [num blocks][offset of each block and end]blocks..., a block is
+    // (compressed) varint length prefixed values, pfd keep block << slot_bits | slot
+    kBlockLayout = 1,
+    // values of int32 width in key id order without pfd, value of id is at id * width
+    kFixedLayout = 2,
+    // as kPerLengthLayout, but a pfd entry is offset << 1, or a raw value of
+    // at most 7 bytes as bytes << 4 | length << 1 | 1
+    kPerLengthInlineLayout = 3,
+};
+
+const size_t kMaxInlineValueBytes = 7;
+
+// Key order section: uint64 n, uint64 flags, uint32 key ids in key order,
+// then with kWithWeights a max tree of 2n float: node i >= 1 is max of 2i
+// and 2i+1, leaf n + i is weight of i-th key. Keys of a prefix are a range
+// of the ids
+enum KeyOrderFlag
+{
+    kWithWeights = 1,
+};
+
+// A value of delta file starts with a tag, a tombstone has nothing after tag
+enum DeltaTag
+{
+    kDeltaUpsert = 'U',
+    kDeltaTombstone = 'D',
+};
+
+// Manifest of a sharded dataset: tag, int32 num shards, then int32 length
+// and name of each shard file, relative to directory of the manifest
+const char kShardManifestTag[] = "SCDBS1.";
+
+// Shard of [key] in a dataset of [num_shards] shards
+inline uint32_t ShardOf(const StringPiece& key, uint32_t num_shards)
+{
+    return util::Hash64(key.data(), key.length()) % num_shards;
+}
+
+inline std::string VersionTag(int version)
+{
+    return "SCDBV" + std::to_string(version) + ".";
+}
+
+// Return format version of the tag [data] starts with, 0 if it does not
+// start with a valid tag. Tags of versions after 9 are longer than
+// kVersionTagLength, up to kMaxVersionTagLength
+inline int ParseVersionTag(const StringPiece& data)
+{
+    if (data.length() < kVersionTagLength || strncmp(data.data(), "SCDBV", 5) != 0)
+        return 0;
+
+    int64_t version = 0;
+    size_t i = 5;
+    for (;i < data.length() && i + 1 < kMaxVersionTagLength && isdigit(data[i]); i++)
+    {
+        version = version * 10 + (data[i] - '0');
+    }
+    if (i == 5 || i >= data.length() || data[i] != '.')
+        return 0;
+    if (version < 1 || version > kFormatVersion)
+        return 0;
+    return version;
+}
+
+} // namespace
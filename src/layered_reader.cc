@@ -0,0 +1,167 @@
+#include "layered_reader.h"
+
+#include <map>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include "format.h"
+#include "marisa-trie_reader.h"
+
+#include "utils/bloom_filter.h"
+
+namespace scdb {
+
+namespace {
+
+bool IsTombstone(const StringPiece& v)
+{
+    return v.empty() || v[0] != kDeltaUpsert;
+}
+
+} // namespace
+
+LayeredReader::LayeredReader(const Reader::Option& option, const std::string& base, const std::vector<std::string>& deltas)
+{
+    if (!base.empty())
+    {
+        auto reader = new MarisaTrieReader(option, base);
+        base_.reset(reader);
+        if (reader->writer_option().build_type == Writer::kIntMap)
+        {
+            throw std::invalid_argument("layers of kIntMap are not supported: " + base);
+        }
+    }
+
+    // keys only, values of deltas are not read
+    std::vector<uint64_t> hashes;
+    for (auto it = deltas.rbegin(); it != deltas.rend(); ++it)
+    {
+        auto delta = new MarisaTrieReader(option, *it);
+        deltas_.emplace_back(delta);
+        delta->PrefixScanIds("", [&hashes](const StringPiece& k, uint64_t) {
+            hashes.push_back(BloomFilter::Hash(k));
+            return true;
+        });
+    }
+
+    filter_.reset(new BloomFilter(hashes.size()));
+    for (auto h : hashes)
+    {
+        filter_->Add(h);
+    }
+
+    DLOG(INFO) << "layered " << deltas_.size() << " deltas of " << hashes.size() << " keys";
+}
+
+LayeredReader::~LayeredReader()
+{
+}
+
+const Reader* LayeredReader::FindDelta(const StringPiece& k) const
+{
+    if (deltas_.empty() || !filter_->MayContain(BloomFilter::Hash(k)))
+        return NULL;
+
+    for (auto& delta : deltas_)
+    {
+        if (delta->Exist(k))
+            return delta.get();
+    }
+    return NULL;
+}
+
+bool LayeredReader::Exist(const StringPiece& k) const
+{
+    auto delta = FindDelta(k);
+    if (delta)
+        return !IsTombstone(delta->GetAsString(k));
+
+    return base_ && base_->Exist(k);
+}
+
+StringPiece LayeredReader::Get(const StringPiece& k) const
+{
+    auto delta = FindDelta(k);
+    if (!delta)
+        return base_ ? base_->Get(k) : StringPiece();
+
+    // a delta may be written with any codec or layout, its value is read
+    // as a whole into a buffer of the calling thread
+    static thread_local std::string buf;
+    buf = delta->GetAsString(k);
+    if (IsTombstone(buf))
+        return StringPiece();
+
+    return StringPiece(buf.data() + 1, buf.length() - 1);
+}
+
+std::string LayeredReader::GetAsString(const StringPiece& k) const
+{
+    auto delta = FindDelta(k);
+    if (!delta)
+        return base_ ? base_->GetAsString(k) : "";
+
+    auto v = delta->GetAsString(k);
+    if (IsTombstone(v))
+        return "";
+
+    return v.substr(1);
+}
+
+std::vector<std::pair<std::string, std::string>> LayeredReader::PrefixGet(const StringPiece& prefix, size_t count) const
+{
+    std::vector<std::pair<std::string, std::string>> m;
+    if (count == 0)
+        return m;
+
+    PrefixScan(prefix, [&m, count](const StringPiece& k, const std::string& v) {
+        m.push_back(std::make_pair(k.ToString(), v));
+        return m.size() < count;
+    });
+    return m;
+}
+
+void LayeredReader::PrefixScan(const StringPiece& prefix, const Visitor& visitor) const
+{
+    // tagged values of deltas, the newest one is kept
+    std::map<std::string, std::string> overrides;
+    for (auto& delta : deltas_)
+    {
+        delta->PrefixScan(prefix, [&overrides](const StringPiece& k, const std::string& v) {
+            overrides.insert(std::make_pair(k.ToString(), v));
+            return true;
+        });
+    }
+
+    bool stopped = false;
+    if (base_)
+    {
+        base_->PrefixScan(prefix, [&](const StringPiece& k, const std::string& v) {
+            auto it = overrides.find(k.ToString());
+            if (it == overrides.end())
+            {
+                stopped = !visitor(k, v);
+                return !stopped;
+            }
+
+            if (!IsTombstone(it->second))
+            {
+                stopped = !visitor(k, it->second.substr(1));
+            }
+            overrides.erase(it);
+            return !stopped;
+        });
+    }
+
+    // keys only in deltas
+    for (auto it = overrides.begin(); !stopped && it != overrides.end(); ++it)
+    {
+        if (!IsTombstone(it->second))
+        {
+            stopped = !visitor(it->first, it->second.substr(1));
+        }
+    }
+}
+
+} // namespace
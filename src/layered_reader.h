@@ -0,0 +1,48 @@
+#pragma once
+
+#include "scdb/reader.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace scdb {
+
+class BloomFilter;
+
+// A base overlaid by deltas built by DeltaWriter. Deltas are consulted
+// newest first, a bloom filter of all delta keys sends most misses of
+// deltas straight to the base
+class LayeredReader : boost::noncopyable,
+                      public Reader
+{
+public:
+    // [base] may be empty, the last of [deltas] is the newest. Throw
+    // std::invalid_argument if [base] is a kIntMap
+    LayeredReader(const Reader::Option& option, const std::string& base, const std::vector<std::string>& deltas);
+    virtual ~LayeredReader();
+
+    virtual bool Exist(const StringPiece& k) const;
+
+    virtual StringPiece Get(const StringPiece& k) const;
+    virtual std::string GetAsString(const StringPiece& k) const;
+
+    virtual std::vector<std::pair<std::string, std::string>> PrefixGet(const StringPiece& prefix, size_t count) const;
+    // Keys of the base in its scan order, with values of the newest delta
+    // having them, then keys only in deltas in byte order. The two parts
+    // are not merged, as the base scan is in trie order, not byte order
+    virtual void PrefixScan(const StringPiece& prefix, const Visitor& visitor) const;
+
+private:
+    // Return the newest delta having [k], NULL if no delta has it
+    const Reader* FindDelta(const StringPiece& k) const;
+
+    std::unique_ptr<Reader> base_;
+    std::vector<std::unique_ptr<Reader>> deltas_; // newest first
+    boost::scoped_ptr<BloomFilter> filter_;
+};
+
+} // namespace
@@ -3,14 +3,20 @@
 #include <unistd.h>
 #include <sys/mman.h>
 
+#include <mutex>
+#include <queue>
+#include <algorithm>
 #include <exception>
 
 #include "marisa/trie.h"
-#include <snappy.h>
 #include <glog/logging.h>
 
+#include "scdb/codec.h"
 #include "scdb/writer.h"
 
+#include "format.h"
+#include "block_cache.h"
+
 #include "utils/varint.h"
 #include "utils/pfordelta.h"
 #include "utils/timestamp.h"
@@ -24,21 +30,32 @@ class MarisaTrieReader::Impl
 public:
     Impl(const Reader::Option& option, const std::string& fname)
         : option_(option),
-          get_func_(&Impl::GetEmpty),
-          get_as_string_func_(&Impl::GetEmptyAsString),
-          get_as_string_by_id_func_(&Impl::GetEmptyAsStringById)
-
+          value_kind_(kEmptyValue),
+          version_(0),
+          layout_(kPerLengthLayout),
+          inline_values_(false),
+          slot_bits_(0),
+          num_blocks_(0),
+          blocks_ptr_(NULL),
+          num_ordered_keys_(0),
+          ordered_ids_ptr_(NULL),
+          weight_tree_ptr_(NULL)
     {
-        int32_t pfd_offset = 0;
-        int32_t key_trie_offset = 0;
+        int64_t pfd_offset = 0;
+        int64_t key_trie_offset = 0;
         int64_t data_offset = 0;
+        int64_t key_order_offset = 0;
         try
         {
             FileInputStream is(fname); 
-            char buf[7];
-    
-            is.Read(buf, sizeof buf);
-            CHECK(strncmp(buf, "SCDBV1.", sizeof buf) == 0) << "Invalid Format: miss match format";
+            std::string tag(kVersionTagLength, '\0');
+            is.Read(&tag[0], tag.length());
+            while (tag.back() != '.' && tag.length() < kMaxVersionTagLength)
+            {
+                tag.push_back(is.Read<char>());
+            }
+            version_ = ParseVersionTag(tag);
+            CHECK(version_ > 0) << "Invalid Format: miss match format";
     
             is.Read<int64_t>(); // Timestamp
     
@@ -49,27 +66,67 @@ public:
 
             if (writer_option_.build_type == Writer::kMap && writer_option_.compress_type != Writer::kDFA)
             {
-                auto num_key_length = is.Read<int32_t>();
-                auto max_key_length = is.Read<int32_t>();
-    
-                DLOG(INFO) << "num key count " << num_key_length;
-                DLOG(INFO) << "max key length " << max_key_length;
-   
-                data_offsets_.resize(max_key_length+1, 0);
+                if (version_ >= 2)
+                {
+                    layout_ = is.Read<int8_t>();
+                }
+
+                // values are still grouped by key length
+                if (layout_ == kPerLengthInlineLayout)
+                {
+                    inline_values_ = true;
+                    layout_ = kPerLengthLayout;
+                }
+
+                if (layout_ == kBlockLayout)
+                {
+                    slot_bits_ = is.Read<int32_t>();
+                    block_cache_.reset(new BlockCache(option_.block_cache_size));
+                }
+                else if (layout_ == kFixedLayout)
+                {
+                    writer_option_.value_width = is.Read<int32_t>();
+                }
+                else
+                {
+                    ReadDataOffsets(is);
+                }
+
+                std::vector<char> dict;
+                if (writer_option_.compress_type == Writer::kZstdDict)
+                {
+                    auto dict_length = is.Read<int32_t>();
+                    dict.resize(dict_length);
+                    if (dict_length > 0)
+                        is.Read(dict);
+                }
 
-                for (int32_t i = 0;i < num_key_length; i++)
+                if (writer_option_.compress_type != Writer::kNone)
                 {
-                    auto len = is.Read<int32_t>();
-                    data_offsets_[len] = is.Read<int64_t>();
+                    codec_.reset(NewCodec(writer_option_.compress_type, 0, StringPiece(dict.data(), dict.size())));
+                    if (!codec_)
+                    {
+                        throw std::runtime_error("unknown codec " + std::to_string(writer_option_.compress_type));
+                    }
                 }
             }
     
-            pfd_offset = is.Read<int32_t>();
-            key_trie_offset = is.Read<int32_t>();
-            data_offset = is.Read<int64_t>();
+            if (version_ >= 2)
+            {
+                pfd_offset = is.Read<int64_t>();
+                key_trie_offset = is.Read<int64_t>();
+                data_offset = is.Read<int64_t>();
+                key_order_offset = is.Read<int64_t>();
+            }
+            else
+            {
+                pfd_offset = is.Read<int32_t>();
+                key_trie_offset = is.Read<int32_t>();
+                data_offset = is.Read<int64_t>();
+            }
 
             // Must Load pfd first
-            if (writer_option_.build_type == Writer::kMap)
+            if (writer_option_.build_type != Writer::kSet && layout_ != kFixedLayout)
             {
                 pfd_.Load(fname, pfd_offset);
             }
@@ -109,30 +166,77 @@ public:
 
         if (writer_option_.compress_type == Writer::kDFA)
         {
-            value_trie_.map(data_ptr_, length_ - sizeof(uint32_t) - data_offset);
+            auto checksum_length = writer_option_.with_checksum ? sizeof(int32_t) : 0;
+            auto data_end = key_order_offset > 0 ? key_order_offset : length_ - checksum_length;
+            value_trie_.map(data_ptr_, data_end - data_offset);
         }
 
-        if (writer_option_.build_type == Writer::kMap)
+        if (key_order_offset > 0)
+        {
+            auto p = ptr_ + page_offset + (key_order_offset - key_trie_offset);
+            memcpy(&num_ordered_keys_, p, sizeof num_ordered_keys_);
+            p += sizeof(uint64_t);
+
+            uint64_t flags;
+            memcpy(&flags, p, sizeof flags);
+            p += sizeof(uint64_t);
+
+            ordered_ids_ptr_ = p;
+            if (flags & kWithWeights)
+            {
+                weight_tree_ptr_ = ordered_ids_ptr_ + num_ordered_keys_ * sizeof(uint32_t);
+            }
+        }
+
+        if (layout_ == kBlockLayout)
+        {
+            memcpy(&num_blocks_, data_ptr_, sizeof num_blocks_);
+            blocks_ptr_ = data_ptr_ + sizeof(uint64_t) * (num_blocks_ + 2);
+
+            value_kind_ = kBlockValue;
+        }
+        else if (layout_ == kFixedLayout)
+        {
+            value_kind_ = kFixedValue;
+        }
+        else if (writer_option_.build_type == Writer::kIntMap)
+        {
+            value_kind_ = kIntValue;
+        }
+        else if (writer_option_.build_type == Writer::kMap)
         {
             switch (writer_option_.compress_type)
             {
                 case Writer::kNone:
-                    get_func_ = &Impl::GetRawValue;
-                    get_as_string_func_ = &Impl::GetRawValueAsString;
-                    get_as_string_by_id_func_ = &Impl::GetRawValueAsStringById;
-                    break;
-                case Writer::kSnappy:
-                    get_as_string_func_ = &Impl::GetCompressedValueAsString;
-                    get_as_string_by_id_func_ = &Impl::GetCompressedValueAsStringById;
+                    value_kind_ = kRawValue;
                     break;
                 case Writer::kDFA:
-                    get_as_string_func_ = &Impl::GetDFAValue;
-                    get_as_string_by_id_func_ = &Impl::GetDFAValueById;
+                    value_kind_ = kDFAValue;
+                    break;
+                default:
+                    value_kind_ = kCompressedValue;
                     break;
             }
         }
     }
     
+    void ReadDataOffsets(FileInputStream& is)
+    {
+        auto num_key_length = is.Read<int32_t>();
+        auto max_key_length = is.Read<int32_t>();
+
+        DLOG(INFO) << "num key count " << num_key_length;
+        DLOG(INFO) << "max key length " << max_key_length;
+
+        data_offsets_.resize(max_key_length+1, 0);
+
+        for (int32_t i = 0;i < num_key_length; i++)
+        {
+            auto len = is.Read<int32_t>();
+            data_offsets_[len] = is.Read<int64_t>();
+        }
+    }
+
     ~Impl()
     {
         ::munmap(ptr_, length_);
@@ -169,6 +273,99 @@ public:
         return m;
     }
 
+    void PrefixScan(const StringPiece& k, const Reader::Visitor& visitor) const
+    {
+        marisa::Agent agent;
+        agent.set_query(k.data(), k.length());
+        try
+        {
+            while (key_trie_.predictive_search(agent))
+            {
+                auto& key = agent.key();
+                if (!visitor(StringPiece(key.ptr(), key.length()), GetAsStringById(key.id(), key.length())))
+                    break;
+            }
+        }
+        catch (const marisa::Exception &ex)
+        {
+            LOG(ERROR) << ex.what() << ": PrefixScan() failed: "
+                       << k.ToString();
+        }
+    }
+
+    bool PrefixScanStored(const StringPiece& k, const MarisaTrieReader::StoredVisitor& visitor) const
+    {
+        if (!IsStoredOneByOne())
+        {
+            return false;
+        }
+
+        marisa::Agent agent;
+        agent.set_query(k.data(), k.length());
+        try
+        {
+            while (key_trie_.predictive_search(agent))
+            {
+                auto& key = agent.key();
+                bool raw;
+                auto stored = GetStoredValueById(key.id(), key.length(), &raw);
+                if (!visitor(StringPiece(key.ptr(), key.length()), stored, raw))
+                    break;
+            }
+        }
+        catch (const marisa::Exception &ex)
+        {
+            LOG(ERROR) << ex.what() << ": PrefixScanStored() failed: "
+                       << k.ToString();
+        }
+        return true;
+    }
+
+    bool IsStoredOneByOne() const
+    {
+        return writer_option_.build_type == Writer::kMap && writer_option_.compress_type != Writer::kDFA
+            && layout_ == kPerLengthLayout;
+    }
+
+    bool GetStoredById(uint64_t id, size_t key_length, StringPiece* stored, bool* raw) const
+    {
+        if (!IsStoredOneByOne())
+            return false;
+
+        if (id >= size())
+        {
+            throw std::out_of_range("key id " + std::to_string(id) + " out of range " + std::to_string(size()));
+        }
+
+        *stored = GetStoredValueById(id, key_length, raw);
+        return true;
+    }
+
+    void PrefixScanIds(const StringPiece& k, const MarisaTrieReader::IdVisitor& visitor) const
+    {
+        marisa::Agent agent;
+        agent.set_query(k.data(), k.length());
+        try
+        {
+            while (key_trie_.predictive_search(agent))
+            {
+                auto& key = agent.key();
+                if (!visitor(StringPiece(key.ptr(), key.length()), key.id()))
+                    break;
+            }
+        }
+        catch (const marisa::Exception &ex)
+        {
+            LOG(ERROR) << ex.what() << ": PrefixScanIds() failed: "
+                       << k.ToString();
+        }
+    }
+
+    const Writer::Option& writer_option() const
+    {
+        return writer_option_;
+    }
+
     StringPiece GetRawValue(const StringPiece& k) const
     {
         StringPiece result("");
@@ -189,12 +386,46 @@ public:
 
     StringPiece GetRawValueById(uint32_t id, size_t len) const
     {
-        auto offset = pfd_.Extract(id);
+        bool raw;
+        return GetStoredValueById(id, len, &raw);
+    }
+
+    // value as stored in data section, [raw] is false if it should be
+    // uncompressed by codec. An inline value is restored into a buffer of
+    // the calling thread, valid until the next call on any reader of it
+    StringPiece GetStoredValueById(uint32_t id, size_t len, bool* raw) const
+    {
+        return GetStoredValue(pfd_.Extract(id), len, raw);
+    }
+
+    // as GetStoredValueById, of pfd entry [offset] extracted by the caller
+    StringPiece GetStoredValue(uint64_t offset, size_t len, bool* raw) const
+    {
+        if (inline_values_)
+        {
+            if (offset & 1)
+            {
+                static thread_local char buf[kMaxInlineValueBytes];
+                uint64_t bytes = offset >> 4;
+                memcpy(buf, &bytes, kMaxInlineValueBytes);
+                *raw = true;
+                return StringPiece(buf, (offset >> 1) & 7);
+            }
+            offset >>= 1;
+        }
+
         auto data_offset = data_offsets_[len];
         auto block_ptr = reinterpret_cast<const int8_t*>(data_ptr_ + data_offset + offset);
 
         size_t prefix_length;
         auto value_length = DecodeVarint(block_ptr, block_ptr + 10, &prefix_length);
+
+        *raw = !codec_;
+        if (codec_ && version_ >= 2)
+        {
+            *raw = value_length & 1;
+            value_length >>= 1;
+        }
         return StringPiece(reinterpret_cast<const char*>(block_ptr + prefix_length), value_length);
     }
 
@@ -208,111 +439,983 @@ public:
         return GetRawValueById(id, len).ToString();
     }
 
-    StringPiece GetEmpty(const StringPiece& key) const
+    size_t size() const
     {
-        return StringPiece("");
+        return key_trie_.num_keys();
     }
 
-    std::string GetEmptyAsString(const StringPiece& key) const
+    bool LookupId(const StringPiece& key, uint64_t* id) const
     {
-        return "";
+        auto& agent = ThreadAgent();
+        agent.set_query(key.data(), key.length());
+        if (!key_trie_.lookup(agent))
+        {
+            return false;
+        }
+
+        *id = agent.key().id();
+        return true;
     }
 
-    std::string GetEmptyAsStringById(uint32_t id, size_t len) const
+    std::string KeyById(uint64_t id) const
     {
-        return "";
+        auto key = ReverseLookup(id);
+        return std::string(key.ptr(), key.length());
     }
 
-    std::string GetDFAValueById(uint32_t id, size_t) const
+    std::string GetById(uint64_t id) const
     {
-        auto idx = pfd_.Extract(id);
-        marisa::Agent agent;
-        agent.set_query(idx);
-        std::string result;
-        key_trie_.reverse_lookup(agent);
-        return result.assign(agent.key().ptr(), agent.key().length());
+        // only values grouped by key length need the key
+        size_t len = 0;
+        if (IsStoredOneByOne())
+        {
+            len = ReverseLookup(id).length();
+        }
+        else if (id >= size())
+        {
+            throw std::out_of_range("key id " + std::to_string(id) + " out of range " + std::to_string(size()));
+        }
+
+        return GetAsStringById(id, len);
     }
 
-    std::string GetDFAValue(const StringPiece& key) const
+    void CommonPrefixes(const StringPiece& query, const MarisaTrieReader::PrefixVisitor& visitor) const
     {
+        // a local agent, the thread agent may be used by GetValueById
         marisa::Agent agent;
-        agent.set_query(key.data(), key.length());
-        if (!key_trie_.lookup(agent))
+        agent.set_query(query.data(), query.length());
+        try
         {
-            return "";
+            while (key_trie_.common_prefix_search(agent))
+            {
+                auto& key = agent.key();
+                if (!visitor(StringPiece(query.data(), key.length()), GetValueById(key.id(), key.length())))
+                    break;
+            }
+        }
+        catch (const marisa::Exception &ex)
+        {
+            LOG(ERROR) << ex.what() << ": CommonPrefixes() failed: "
+                       << query.ToString();
         }
-        return GetDFAValueById(agent.key().id(), 0);
     }
 
-    std::string GetCompressedValueAsString(const StringPiece& key) const
+    bool LongestPrefixGet(const StringPiece& query, StringPiece* key, StringPiece* value) const
     {
-        auto v = GetRawValue(key);
-        std::string ucv;
-        snappy::Uncompress(v.data(), v.length(), &ucv);
-        return ucv;
+        marisa::Agent agent;
+        agent.set_query(query.data(), query.length());
+
+        bool found = false;
+        size_t id = 0;
+        size_t len = 0;
+        try
+        {
+            while (key_trie_.common_prefix_search(agent))
+            {
+                found = true;
+                id = agent.key().id();
+                len = agent.key().length();
+            }
+        }
+        catch (const marisa::Exception &ex)
+        {
+            LOG(ERROR) << ex.what() << ": LongestPrefixGet() failed: "
+                       << query.ToString();
+            return false;
+        }
+
+        if (found)
+        {
+            *key = StringPiece(query.data(), len);
+            *value = GetValueById(id, len);
+        }
+        return found;
     }
 
-    std::string GetCompressedValueAsStringById(uint32_t id, size_t len) const
+    // Value of [id] without copy if it is stored as is
+    StringPiece GetValueById(uint32_t id, size_t len) const
     {
-        auto v = GetRawValueById(id, len);
-        std::string ucv;
-        snappy::Uncompress(v.data(), v.length(), &ucv);
-        return ucv;
+        if (layout_ == kFixedLayout)
+        {
+            return GetFixedValueById(id);
+        }
+
+        if (writer_option_.build_type == Writer::kMap && writer_option_.compress_type == Writer::kNone
+            && layout_ == kPerLengthLayout)
+        {
+            return GetRawValueById(id, len);
+        }
+
+        static thread_local std::string buf;
+        buf = GetAsStringById(id, len);
+        return StringPiece(buf);
     }
 
-    bool Exist(const StringPiece& key) const
+    // Depth first walk of key trie, a level keeps the row of edit distances
+    // between its prefix and each prefix of the query. A child is visited
+    // only if its row may still end within the bound, which shrinks to the
+    // distance of the limit-th closest match found so far. With key order
+    // only children that exist are visited, see FuzzyWalkOrdered
+    std::vector<MarisaTrieReader::FuzzyMatch> FuzzySearch(const StringPiece& query, int max_edits,
+                                                          size_t limit, bool with_values) const
     {
+        FuzzyState state(query, max_edits, limit, with_values);
+        if (max_edits < 0 || limit == 0)
+            return state.matches;
+
+        std::vector<int> row(query.length() + 1);
+        for (size_t j = 0;j < row.size(); j++)
+        {
+            row[j] = j;
+        }
+
+        std::string prefix;
         marisa::Agent agent;
-        agent.set_query(key.data(), key.length());
-        return key_trie_.lookup(agent);
+        try
+        {
+            if (ordered_ids_ptr_)
+                FuzzyWalkOrdered(row, 0, num_ordered_keys_, &prefix, &agent, &state);
+            else
+                FuzzyWalk(Alphabet(), row, &prefix, &agent, &state);
+        }
+        catch (const marisa::Exception &ex)
+        {
+            LOG(ERROR) << ex.what() << ": FuzzySearch() failed: "
+                       << query.ToString();
+        }
+
+        auto& matches = state.matches;
+        std::sort(matches.begin(), matches.end(), [](const MarisaTrieReader::FuzzyMatch& a, const MarisaTrieReader::FuzzyMatch& b) {
+            return a.distance != b.distance ? a.distance < b.distance : a.key < b.key;
+        });
+        if (matches.size() > limit)
+            matches.resize(limit);
+        return matches;
     }
 
-    StringPiece Get(const StringPiece& key) const
+    struct FuzzyState
+    {
+        FuzzyState(const StringPiece& q, int max_edits, size_t n, bool values)
+            : query(q),
+              bound(max_edits),
+              limit(n),
+              with_values(values),
+              counts(std::max(max_edits, 0) + 1, 0)
+        {}
+
+        StringPiece query;
+        int bound; // max distance of a match still wanted
+        size_t limit;
+        bool with_values;
+        std::vector<size_t> counts; // matches of each distance
+        std::vector<MarisaTrieReader::FuzzyMatch> matches;
+    };
+
+    // Row of the child by [c] from [row] of its parent, return the min of it
+    static int NextFuzzyRow(const StringPiece& query, const std::vector<int>& row, uint8_t c, std::vector<int>* next)
     {
-        return (this->*get_func_)(key);
+        auto& r = *next;
+        r[0] = row[0] + 1;
+        int min_distance = r[0];
+        for (size_t j = 1;j < row.size(); j++)
+        {
+            auto cost = static_cast<uint8_t>(query[j-1]) == c ? 0 : 1;
+            r[j] = std::min(std::min(row[j] + 1, r[j-1] + 1), row[j-1] + cost);
+            min_distance = std::min(min_distance, r[j]);
+        }
+        return min_distance;
     }
 
-    std::string GetAsString(const StringPiece& key) const
+    // Keys in [lo, hi) of key order all start with [prefix]. The first key
+    // longer than it names a child, whose range is found by a search in the
+    // parent's and walked down, then the next child starts past it. So only
+    // children that exist are visited, each by a search within the range
+    // of its parent rather than from the root
+    void FuzzyWalkOrdered(const std::vector<int>& row, uint64_t lo, uint64_t hi,
+                          std::string* prefix, marisa::Agent* agent, FuzzyState* state) const
     {
-        return (this->*get_as_string_func_)(key);
+        std::vector<int> next(row.size());
+        while (lo < hi)
+        {
+            auto id = OrderedKeyId(lo);
+            auto& key = ReverseLookup(id, agent);
+            if (key.length() == prefix->length())
+            {
+                // the prefix itself, matched by the parent
+                lo++;
+                continue;
+            }
+
+            // the child is a key if it is the first key of its range
+            uint8_t c = key.ptr()[prefix->length()];
+            bool is_key = key.length() == prefix->length() + 1;
+            prefix->push_back(c);
+            auto end = LowerBound(*prefix, true, lo, hi, agent);
+            if (NextFuzzyRow(state->query, row, c, &next) <= state->bound)
+            {
+                if (next.back() <= state->bound && is_key)
+                {
+                    AddFuzzyMatch(id, *prefix, next.back(), state);
+                }
+                FuzzyWalkOrdered(next, lo, end, prefix, agent, state);
+            }
+            prefix->pop_back();
+            lo = end;
+        }
     }
 
-    std::string GetAsStringById(uint32_t id, size_t len) const
+    // Without key order each byte of [alphabet] is probed as a child. One
+    // search of a child finds its first key, which is the child itself if
+    // it is a key, so no lookup is needed for a match
+    void FuzzyWalk(const std::vector<uint8_t>& alphabet, const std::vector<int>& row, std::string* prefix,
+                   marisa::Agent* agent, FuzzyState* state) const
     {
-        return (this->*get_as_string_by_id_func_)(id, len);
+        std::vector<int> next(row.size());
+        for (auto c : alphabet)
+        {
+            if (NextFuzzyRow(state->query, row, c, &next) > state->bound)
+                continue;
+
+            prefix->push_back(c);
+            agent->set_query(prefix->data(), prefix->length());
+            if (key_trie_.predictive_search(*agent))
+            {
+                if (next.back() <= state->bound && agent->key().length() == prefix->length())
+                {
+                    AddFuzzyMatch(agent->key().id(), *prefix, next.back(), state);
+                }
+                FuzzyWalk(alphabet, next, prefix, agent, state);
+            }
+            prefix->pop_back();
+        }
     }
 
-private:
-    Reader::Option option_;
-    Writer::Option writer_option_;
+    // Bytes used by keys, found by one scan of the keys on first use, so
+    // files never searched fuzzily pay nothing
+    const std::vector<uint8_t>& Alphabet() const
+    {
+        std::call_once(alphabet_once_, [this]() {
+            bool used[256] = {false};
+            marisa::Agent agent;
+            agent.set_query("", 0);
+            while (key_trie_.predictive_search(agent))
+            {
+                auto p = reinterpret_cast<const uint8_t*>(agent.key().ptr());
+                for (size_t i = 0;i < agent.key().length(); i++)
+                {
+                    used[p[i]] = true;
+                }
+            }
 
-    typedef StringPiece (Impl::*GetFunc)(const StringPiece&) const;
-    typedef std::string (Impl::*GetAsStringFunc)(const StringPiece&) const;
-    typedef std::string (Impl::*GetAsStringByIdFunc)(uint32_t id, size_t len) const;
-    typedef bool (Impl::*ExistFunc)(const StringPiece&) const;
+            for (size_t c = 0;c < 256; c++)
+            {
+                if (used[c])
+                    alphabet_.push_back(c);
+            }
+        });
+        return alphabet_;
+    }
 
-    int fd_;
-    uint64_t length_;
-    char* ptr_;
+    // Once limit matches are within a distance, farther keys can not be
+    // among the closest, the bound shrinks to it
+    void AddFuzzyMatch(uint32_t id, const std::string& key, int distance, FuzzyState* state) const
+    {
+        MarisaTrieReader::FuzzyMatch m;
+        m.key = key;
+        m.distance = distance;
+        if (state->with_values)
+            m.value = GetAsStringById(id, key.length());
+        state->matches.push_back(m);
 
-    std::vector<int64_t> data_offsets_;
+        state->counts[distance]++;
+        size_t n = 0;
+        for (int d = 0;d <= state->bound; d++)
+        {
+            n += state->counts[d];
+            if (n >= state->limit)
+            {
+                state->bound = d;
+                break;
+            }
+        }
+    }
 
-    const char* index_ptr_;
-    const char* data_ptr_;
+    // Keys of [prefix] are a range of the ids in key order, without them
+    // the keys are enumerated
+    uint64_t CountPrefix(const StringPiece& prefix) const
+    {
+        marisa::Agent agent;
+        if (ordered_ids_ptr_)
+        {
+            return LowerBound(prefix, true, &agent) - LowerBound(prefix, false, &agent);
+        }
 
-    marisa::Trie key_trie_;
-    marisa::Trie value_trie_;
-    PForDelta pfd_;
+        uint64_t n = 0;
+        agent.set_query(prefix.data(), prefix.length());
+        while (key_trie_.predictive_search(agent))
+        {
+            n++;
+        }
+        return n;
+    }
 
-    GetFunc get_func_;
-    GetAsStringFunc get_as_string_func_;
-    GetAsStringByIdFunc get_as_string_by_id_func_;
-}; 
+    // Leaves of the max tree in [lo, hi) are keys of the prefix. Nodes
+    // covering the range are expanded best first, a leaf popped is the
+    // heaviest key left
+    std::vector<std::pair<std::string, float>> TopKPrefix(const StringPiece& prefix, size_t k) const
+    {
+        if (!weight_tree_ptr_)
+        {
+            throw std::runtime_error("no weights in file");
+        }
 
-MarisaTrieReader::MarisaTrieReader(const Reader::Option& option, const std::string& fname)
-    : impl_(new Impl(option, fname))
-{
-}
+        std::vector<std::pair<std::string, float>> top;
+        marisa::Agent agent;
+        auto n = num_ordered_keys_;
+        auto lo = LowerBound(prefix, false, &agent);
+        auto hi = LowerBound(prefix, true, &agent);
+
+        std::priority_queue<std::pair<float, uint64_t>> heap;
+        for (auto l = lo + n, r = hi + n; l < r; l >>= 1, r >>= 1)
+        {
+            if (l & 1)
+            {
+                heap.push(std::make_pair(WeightNode(l), l));
+                l++;
+            }
+            if (r & 1)
+            {
+                r--;
+                heap.push(std::make_pair(WeightNode(r), r));
+            }
+        }
+
+        while (!heap.empty() && top.size() < k)
+        {
+            auto node = heap.top().second;
+            heap.pop();
+            if (node >= n)
+            {
+                auto& key = ReverseLookup(OrderedKeyId(node - n), &agent);
+                top.push_back(std::make_pair(std::string(key.ptr(), key.length()), WeightNode(node)));
+                continue;
+            }
+
+            heap.push(std::make_pair(WeightNode(2*node), 2*node));
+            heap.push(std::make_pair(WeightNode(2*node+1), 2*node+1));
+        }
+        return top;
+    }
+
+    // First position in key order not less than [prefix], or with [past]
+    // the first one after all keys starting with [prefix]
+    uint64_t LowerBound(const StringPiece& prefix, bool past, marisa::Agent* agent) const
+    {
+        return LowerBound(prefix, past, 0, num_ordered_keys_, agent);
+    }
+
+    // As above, within positions [lo, hi) known to hold the answer
+    uint64_t LowerBound(const StringPiece& prefix, bool past, uint64_t lo, uint64_t hi, marisa::Agent* agent) const
+    {
+        while (lo < hi)
+        {
+            auto mid = lo + (hi - lo) / 2;
+            auto& key = ReverseLookup(OrderedKeyId(mid), agent);
+            StringPiece s(key.ptr(), key.length());
+            if (past && s.length() > prefix.length())
+                s = StringPiece(s.data(), prefix.length());
+
+            if (past ? !(prefix < s) : s < prefix)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    MarisaTrieReader::Sections sections() const
+    {
+        MarisaTrieReader::Sections sections;
+        sections.value_kind = value_kind_;
+        sections.key_trie = &key_trie_;
+        sections.pfd = &pfd_;
+        sections.data_ptr = data_ptr_;
+        sections.data_offsets = data_offsets_.empty() ? NULL : data_offsets_.data();
+        sections.inline_values = inline_values_;
+        sections.value_width = writer_option_.value_width;
+        return sections;
+    }
+
+    uint64_t NumOrderedKeys() const
+    {
+        return ordered_ids_ptr_ ? num_ordered_keys_ : 0;
+    }
+
+    uint32_t OrderedKeyId(uint64_t i) const
+    {
+        uint32_t id;
+        memcpy(&id, ordered_ids_ptr_ + i * sizeof id, sizeof id);
+        return id;
+    }
+
+    float WeightNode(uint64_t i) const
+    {
+        float w;
+        memcpy(&w, weight_tree_ptr_ + i * sizeof w, sizeof w);
+        return w;
+    }
+
+    const marisa::Key& ReverseLookup(uint64_t id, marisa::Agent* agent) const
+    {
+        agent->set_query(static_cast<size_t>(id));
+        key_trie_.reverse_lookup(*agent);
+        return agent->key();
+    }
+
+    // key of [id] in the agent of the calling thread
+    const marisa::Key& ReverseLookup(uint64_t id) const
+    {
+        if (id >= size())
+        {
+            throw std::out_of_range("key id " + std::to_string(id) + " out of range " + std::to_string(size()));
+        }
+
+        return ReverseLookup(id, &ThreadAgent());
+    }
+
+    // value of id is at id * value_width of data section
+    StringPiece GetFixedValue(const StringPiece& key) const
+    {
+        marisa::Agent agent;
+        agent.set_query(key.data(), key.length());
+        if (!key_trie_.lookup(agent))
+        {
+            return StringPiece("");
+        }
+
+        return GetFixedValueById(agent.key().id());
+    }
+
+    StringPiece GetFixedValueById(uint32_t id) const
+    {
+        auto width = writer_option_.value_width;
+        return StringPiece(data_ptr_ + static_cast<uint64_t>(id) * width, width);
+    }
+
+    std::string GetFixedValueAsString(const StringPiece& key) const
+    {
+        return GetFixedValue(key).ToString();
+    }
+
+    std::string GetFixedValueAsStringById(uint32_t id, size_t) const
+    {
+        return GetFixedValueById(id).ToString();
+    }
+
+    // Keys are looked up and their values prefetched first, then copied.
+    // Return false if values are not of kFixedLayout
+    bool GatherFixedValues(const StringPiece* keys, size_t n, char* out, size_t stride, bool* found) const
+    {
+        if (layout_ != kFixedLayout)
+            return false;
+
+        auto width = static_cast<size_t>(writer_option_.value_width);
+        auto& agent = ThreadAgent();
+        std::vector<const char*> values(n);
+        for (size_t i = 0;i < n; i++)
+        {
+            agent.set_query(keys[i].data(), keys[i].length());
+            found[i] = key_trie_.lookup(agent);
+            if (found[i])
+            {
+                values[i] = GetFixedValueById(agent.key().id()).data();
+                __builtin_prefetch(values[i]);
+            }
+        }
+
+        auto length = std::min(width, stride);
+        for (size_t i = 0;i < n; i++)
+        {
+            auto dst = out + i * stride;
+            if (found[i])
+            {
+                memcpy(dst, values[i], length);
+                memset(dst + length, 0, stride - length);
+            }
+            else
+            {
+                memset(dst, 0, stride);
+            }
+        }
+        return true;
+    }
+
+    // values of kIntMap are kept in the pfd
+    bool GetInt(const StringPiece& key, uint64_t* v) const
+    {
+        if (writer_option_.build_type != Writer::kIntMap)
+        {
+            throw std::runtime_error("GetInt expects kIntMap");
+        }
+
+        auto& agent = ThreadAgent();
+        agent.set_query(key.data(), key.length());
+        if (!key_trie_.lookup(agent))
+        {
+            return false;
+        }
+
+        *v = pfd_.Extract(agent.key().id());
+        return true;
+    }
+
+    // The except mode of the pfd is picked once for all keys
+    void MultiGetInt(const StringPiece* keys, size_t n, uint64_t* values, bool* found) const
+    {
+        if (writer_option_.build_type != Writer::kIntMap)
+        {
+            throw std::runtime_error("GetInt expects kIntMap");
+        }
+
+        switch (pfd_.except_mode())
+        {
+            case PForDelta::kExceptMin:
+                MultiGetIntAs<PForDelta::kExceptMin>(keys, n, values, found);
+                break;
+            case PForDelta::kExceptBoth:
+                MultiGetIntAs<PForDelta::kExceptBoth>(keys, n, values, found);
+                break;
+            default:
+                MultiGetIntAs<PForDelta::kExceptMax>(keys, n, values, found);
+                break;
+        }
+    }
+
+    template <PForDelta::ExceptMode kMode>
+    void MultiGetIntAs(const StringPiece* keys, size_t n, uint64_t* values, bool* found) const
+    {
+        auto& agent = ThreadAgent();
+        for (size_t i = 0;i < n; i++)
+        {
+            agent.set_query(keys[i].data(), keys[i].length());
+            found[i] = key_trie_.lookup(agent);
+            values[i] = found[i] ? pfd_.ExtractAs<kMode>(agent.key().id()) : 0;
+        }
+    }
+
+    // decimal of the value, in a buffer of the calling thread
+    StringPiece GetIntValue(const StringPiece& key) const
+    {
+        static thread_local std::string buf;
+        uint64_t v;
+        if (!GetInt(key, &v))
+        {
+            return StringPiece("");
+        }
+
+        buf = std::to_string(v);
+        return StringPiece(buf);
+    }
+
+    std::string GetIntValueAsString(const StringPiece& key) const
+    {
+        uint64_t v;
+        if (!GetInt(key, &v))
+        {
+            return "";
+        }
+        return std::to_string(v);
+    }
+
+    std::string GetIntValueAsStringById(uint32_t id, size_t) const
+    {
+        return std::to_string(pfd_.Extract(id));
+    }
+
+    // Agent of the calling thread, shared by all readers. A value restored
+    // by it stays in its buffer until the next call on any reader of the
+    // thread
+    static marisa::Agent& ThreadAgent()
+    {
+        static thread_local marisa::Agent agent;
+        return agent;
+    }
+
+    // values of kDFA are keys of value trie, the pfd keeps their ids
+    StringPiece GetDFAValue(const StringPiece& key) const
+    {
+        auto& agent = ThreadAgent();
+        agent.set_query(key.data(), key.length());
+        if (!key_trie_.lookup(agent))
+        {
+            return StringPiece("");
+        }
+
+        agent.set_query(pfd_.Extract(agent.key().id()));
+        value_trie_.reverse_lookup(agent);
+        return StringPiece(agent.key().ptr(), agent.key().length());
+    }
+
+    std::string GetDFAValueAsString(const StringPiece& key) const
+    {
+        return GetDFAValue(key).ToString();
+    }
+
+    std::string GetDFAValueById(uint32_t id, size_t) const
+    {
+        auto& agent = ThreadAgent();
+        agent.set_query(pfd_.Extract(id));
+        value_trie_.reverse_lookup(agent);
+        return std::string(agent.key().ptr(), agent.key().length());
+    }
+
+    void MultiGetAsString(const StringPiece* keys, size_t n, std::vector<std::string>* values) const
+    {
+        values->resize(n);
+        switch (value_kind_)
+        {
+            case kRawValue:
+                return MultiGetAsStringOf<kRawValue>(keys, n, values);
+            case kFixedValue:
+                return MultiGetAsStringAs<kFixedValue, PForDelta::kExceptMax>(keys, n, values);
+            case kIntValue:
+                return MultiGetAsStringOf<kIntValue>(keys, n, values);
+            case kDFAValue:
+                return MultiGetAsStringOf<kDFAValue>(keys, n, values);
+            case kCompressedValue:
+                return MultiGetAsStringOf<kCompressedValue>(keys, n, values);
+            case kBlockValue:
+                return MultiGetAsStringOf<kBlockValue>(keys, n, values);
+            default:
+                return MultiGetAsStringAs<kEmptyValue, PForDelta::kExceptMax>(keys, n, values);
+        }
+    }
+
+    // The except mode of the pfd is picked once for a batch as well
+    template <int kKind>
+    void MultiGetAsStringOf(const StringPiece* keys, size_t n, std::vector<std::string>* values) const
+    {
+        switch (pfd_.except_mode())
+        {
+            case PForDelta::kExceptMin:
+                return MultiGetAsStringAs<kKind, PForDelta::kExceptMin>(keys, n, values);
+            case PForDelta::kExceptBoth:
+                return MultiGetAsStringAs<kKind, PForDelta::kExceptBoth>(keys, n, values);
+            default:
+                return MultiGetAsStringAs<kKind, PForDelta::kExceptMax>(keys, n, values);
+        }
+    }
+
+    // [kKind] is value_kind_ of the file, known to the caller, so the whole
+    // lookup of a batch is inlined instead of dispatched per key
+    template <int kKind, PForDelta::ExceptMode kMode>
+    void MultiGetAsStringAs(const StringPiece* keys, size_t n, std::vector<std::string>* values) const
+    {
+        if (kKind == kDFAValue)
+        {
+            MultiGetDFAValuesAs<kMode>(keys, n, values);
+            return ;
+        }
+
+        auto& agent = ThreadAgent();
+        for (size_t i = 0;i < n; i++)
+        {
+            agent.set_query(keys[i].data(), keys[i].length());
+            if (!key_trie_.lookup(agent))
+            {
+                (*values)[i].clear();
+                continue;
+            }
+
+            auto id = agent.key().id();
+            bool raw;
+            switch (kKind)
+            {
+                case kRawValue:
+                    GetStoredValue(pfd_.ExtractAs<kMode>(id), keys[i].length(), &raw).CopyToString(&(*values)[i]);
+                    break;
+                case kFixedValue:
+                    GetFixedValueById(id).CopyToString(&(*values)[i]);
+                    break;
+                case kIntValue:
+                    (*values)[i] = std::to_string(pfd_.ExtractAs<kMode>(id));
+                    break;
+                case kCompressedValue:
+                    (*values)[i] = GetCompressedValue(pfd_.ExtractAs<kMode>(id), keys[i].length());
+                    break;
+                case kBlockValue:
+                    (*values)[i] = GetBlockValue(pfd_.ExtractAs<kMode>(id));
+                    break;
+                default:
+                    (*values)[i].clear();
+                    break;
+            }
+        }
+    }
+
+    // Keys are looked up first, then values of kDFA are restored in order
+    // of value id, so the value trie is walked forward and a value shared
+    // by many keys is restored once
+    template <PForDelta::ExceptMode kMode>
+    void MultiGetDFAValuesAs(const StringPiece* keys, size_t n, std::vector<std::string>* values) const
+    {
+        auto& agent = ThreadAgent();
+        std::vector<std::pair<uint64_t, size_t>> ids; // (value id, index of key)
+        ids.reserve(n);
+        for (size_t i = 0;i < n; i++)
+        {
+            agent.set_query(keys[i].data(), keys[i].length());
+            if (key_trie_.lookup(agent))
+            {
+                ids.push_back(std::make_pair(pfd_.ExtractAs<kMode>(agent.key().id()), i));
+            }
+            else
+            {
+                (*values)[i].clear();
+            }
+        }
+        std::sort(ids.begin(), ids.end());
+
+        for (size_t i = 0;i < ids.size(); i++)
+        {
+            auto& value = (*values)[ids[i].second];
+            if (i > 0 && ids[i].first == ids[i-1].first)
+            {
+                value = (*values)[ids[i-1].second];
+                continue;
+            }
+
+            agent.set_query(ids[i].first);
+            value_trie_.reverse_lookup(agent);
+            value.assign(agent.key().ptr(), agent.key().length());
+        }
+    }
+
+    // value of a compressed or block file uncompressed into a buffer of the
+    // calling thread
+    StringPiece GetUncompressedValue(const StringPiece& key) const
+    {
+        static thread_local std::string buf;
+        buf = GetAsString(key);
+        return StringPiece(buf);
+    }
+
+    std::string GetCompressedValueAsString(const StringPiece& key) const
+    {
+        marisa::Agent agent;
+        agent.set_query(key.data(), key.length());
+        if (!key_trie_.lookup(agent))
+        {
+            return "";
+        }
+
+        return GetCompressedValueAsStringById(agent.key().id(), key.length());
+    }
+
+    std::string GetCompressedValueAsStringById(uint32_t id, size_t len) const
+    {
+        return GetCompressedValue(pfd_.Extract(id), len);
+    }
+
+    std::string GetCompressedValue(uint64_t offset, size_t len) const
+    {
+        bool raw;
+        auto v = GetStoredValue(offset, len, &raw);
+        if (raw)
+            return v.ToString();
+
+        std::string ucv;
+        if (!codec_->Uncompress(v, &ucv))
+        {
+            LOG(ERROR) << "uncompress value at " << offset << " of key length " << len << " failed";
+            ucv.clear();
+        }
+        return ucv;
+    }
+
+    std::string GetBlockValueAsString(const StringPiece& key) const
+    {
+        marisa::Agent agent;
+        agent.set_query(key.data(), key.length());
+        if (!key_trie_.lookup(agent))
+        {
+            return "";
+        }
+
+        return GetBlockValueAsStringById(agent.key().id(), key.length());
+    }
+
+    std::string GetBlockValueAsStringById(uint32_t id, size_t) const
+    {
+        return GetBlockValue(pfd_.Extract(id));
+    }
+
+    // [e] is block << slot_bits_ | slot
+    std::string GetBlockValue(uint64_t e) const
+    {
+        auto block = GetBlock(e >> slot_bits_);
+        if (!block)
+        {
+            return "";
+        }
+
+        return block->Value(e & ((1ull << slot_bits_) - 1)).ToString();
+    }
+
+    BlockCache::BlockPtr GetBlock(uint64_t n) const
+    {
+        auto block = block_cache_->Lookup(n);
+        if (block)
+            return block;
+
+        if (n >= num_blocks_)
+        {
+            LOG(ERROR) << "block " << n << " out of range " << num_blocks_;
+            return block;
+        }
+
+        uint64_t offsets[2];
+        memcpy(offsets, data_ptr_ + sizeof(uint64_t) * (n + 1), sizeof offsets);
+        auto begin = reinterpret_cast<const int8_t*>(blocks_ptr_ + offsets[0]);
+        auto end = reinterpret_cast<const int8_t*>(blocks_ptr_ + offsets[1]);
+
+        size_t prefix_length;
+        auto length = DecodeVarint(begin, end, &prefix_length);
+        bool raw = !codec_;
+        if (codec_)
+        {
+            raw = length & 1;
+            length >>= 1;
+        }
+
+        StringPiece stored(reinterpret_cast<const char*>(begin + prefix_length), length);
+        std::string data;
+        if (raw)
+        {
+            stored.CopyToString(&data);
+        }
+        else if (!codec_->Uncompress(stored, &data))
+        {
+            LOG(ERROR) << "uncompress block " << n << " failed";
+            return block;
+        }
+
+        block.reset(new ValueBlock(&data));
+        block_cache_->Insert(n, block);
+        return block;
+    }
+
+    bool Exist(const StringPiece& key) const
+    {
+        auto& agent = ThreadAgent();
+        agent.set_query(key.data(), key.length());
+        return key_trie_.lookup(agent);
+    }
+
+    // A switch on value_kind_ rather than a call through a pointer, so
+    // the lookup of each kind is inlined here
+    StringPiece Get(const StringPiece& key) const
+    {
+        switch (value_kind_)
+        {
+            case kRawValue:
+                return GetRawValue(key);
+            case kFixedValue:
+                return GetFixedValue(key);
+            case kIntValue:
+                return GetIntValue(key);
+            case kDFAValue:
+                return GetDFAValue(key);
+            case kCompressedValue:
+            case kBlockValue:
+                return GetUncompressedValue(key);
+            default:
+                return StringPiece("");
+        }
+    }
+
+    std::string GetAsString(const StringPiece& key) const
+    {
+        switch (value_kind_)
+        {
+            case kRawValue:
+                return GetRawValueAsString(key);
+            case kFixedValue:
+                return GetFixedValueAsString(key);
+            case kIntValue:
+                return GetIntValueAsString(key);
+            case kDFAValue:
+                return GetDFAValueAsString(key);
+            case kCompressedValue:
+                return GetCompressedValueAsString(key);
+            case kBlockValue:
+                return GetBlockValueAsString(key);
+            default:
+                return "";
+        }
+    }
+
+    std::string GetAsStringById(uint32_t id, size_t len) const
+    {
+        switch (value_kind_)
+        {
+            case kRawValue:
+                return GetRawValueAsStringById(id, len);
+            case kFixedValue:
+                return GetFixedValueAsStringById(id, len);
+            case kIntValue:
+                return GetIntValueAsStringById(id, len);
+            case kDFAValue:
+                return GetDFAValueById(id, len);
+            case kCompressedValue:
+                return GetCompressedValueAsStringById(id, len);
+            case kBlockValue:
+                return GetBlockValueAsStringById(id, len);
+            default:
+                return "";
+        }
+    }
+
+private:
+    Reader::Option option_;
+    Writer::Option writer_option_;
+
+    int fd_;
+    uint64_t length_;
+    char* ptr_;
+
+    std::vector<int64_t> data_offsets_;
+
+    const char* index_ptr_;
+    const char* data_ptr_;
+
+    marisa::Trie key_trie_;
+    marisa::Trie value_trie_;
+    PForDelta pfd_;
+
+    ValueKind value_kind_;
+
+    int version_; // format version
+    mutable std::once_flag alphabet_once_;
+    mutable std::vector<uint8_t> alphabet_; // bytes used by keys, found by the first FuzzySearch without key order
+    boost::scoped_ptr<Codec> codec_;
+
+    int layout_; // DataLayout of data section
+    bool inline_values_; // pfd entries of kPerLengthInlineLayout
+    uint32_t slot_bits_;
+    uint64_t num_blocks_;
+    const char* blocks_ptr_;
+    boost::scoped_ptr<BlockCache> block_cache_;
+
+    uint64_t num_ordered_keys_;
+    const char* ordered_ids_ptr_; // key ids in key order, NULL if not kept
+    const char* weight_tree_ptr_; // max tree of weights
+}; 
+
+MarisaTrieReader::MarisaTrieReader(const Reader::Option& option, const std::string& fname)
+    : impl_(new Impl(option, fname))
+{
+}
 
 MarisaTrieReader::~MarisaTrieReader()
 {
@@ -338,4 +1441,117 @@ std::vector<std::pair<std::string, std::string>> MarisaTrieReader::PrefixGet(con
     return impl_->PrefixGet(prefix, count);
 }
 
+void MarisaTrieReader::PrefixScan(const StringPiece& prefix, const Visitor& visitor) const
+{
+    impl_->PrefixScan(prefix, visitor);
+}
+
+void MarisaTrieReader::MultiGetAsString(const StringPiece* keys, size_t n, std::vector<std::string>* values) const
+{
+    impl_->MultiGetAsString(keys, n, values);
+}
+
+size_t MarisaTrieReader::size() const
+{
+    return impl_->size();
+}
+
+bool MarisaTrieReader::LookupId(const StringPiece& k, uint64_t* id) const
+{
+    return impl_->LookupId(k, id);
+}
+
+std::string MarisaTrieReader::KeyById(uint64_t id) const
+{
+    return impl_->KeyById(id);
+}
+
+std::string MarisaTrieReader::GetById(uint64_t id) const
+{
+    return impl_->GetById(id);
+}
+
+void MarisaTrieReader::CommonPrefixes(const StringPiece& query, const PrefixVisitor& visitor) const
+{
+    impl_->CommonPrefixes(query, visitor);
+}
+
+bool MarisaTrieReader::LongestPrefixGet(const StringPiece& query, StringPiece* key, StringPiece* value) const
+{
+    return impl_->LongestPrefixGet(query, key, value);
+}
+
+std::vector<MarisaTrieReader::FuzzyMatch> MarisaTrieReader::FuzzySearch(const StringPiece& query, int max_edits,
+                                                                        size_t limit, bool with_values) const
+{
+    return impl_->FuzzySearch(query, max_edits, limit, with_values);
+}
+
+std::vector<std::pair<std::string, float>> MarisaTrieReader::TopKPrefix(const StringPiece& prefix, size_t k) const
+{
+    return impl_->TopKPrefix(prefix, k);
+}
+
+uint64_t MarisaTrieReader::CountPrefix(const StringPiece& prefix) const
+{
+    return impl_->CountPrefix(prefix);
+}
+
+MarisaTrieReader::Sections MarisaTrieReader::sections() const
+{
+    return impl_->sections();
+}
+
+uint64_t MarisaTrieReader::NumOrderedKeys() const
+{
+    return impl_->NumOrderedKeys();
+}
+
+uint64_t MarisaTrieReader::OrderedKeyId(uint64_t i) const
+{
+    if (i >= impl_->NumOrderedKeys())
+    {
+        throw std::out_of_range("key order " + std::to_string(i) + " out of range " + std::to_string(impl_->NumOrderedKeys()));
+    }
+    return impl_->OrderedKeyId(i);
+}
+
+void MarisaTrieReader::GatherValues(const StringPiece* keys, size_t n, char* out, size_t stride, bool* found) const
+{
+    if (!impl_->GatherFixedValues(keys, n, out, stride, found))
+    {
+        Reader::GatherValues(keys, n, out, stride, found);
+    }
+}
+
+bool MarisaTrieReader::GetInt(const StringPiece& k, uint64_t* v) const
+{
+    return impl_->GetInt(k, v);
+}
+
+void MarisaTrieReader::MultiGetInt(const StringPiece* keys, size_t n, uint64_t* values, bool* found) const
+{
+    impl_->MultiGetInt(keys, n, values, found);
+}
+
+const Writer::Option& MarisaTrieReader::writer_option() const
+{
+    return impl_->writer_option();
+}
+
+bool MarisaTrieReader::PrefixScanStored(const StringPiece& prefix, const StoredVisitor& visitor) const
+{
+    return impl_->PrefixScanStored(prefix, visitor);
+}
+
+bool MarisaTrieReader::GetStoredById(uint64_t id, size_t key_length, StringPiece* stored, bool* raw) const
+{
+    return impl_->GetStoredById(id, key_length, stored, raw);
+}
+
+void MarisaTrieReader::PrefixScanIds(const StringPiece& prefix, const IdVisitor& visitor) const
+{
+    impl_->PrefixScanIds(prefix, visitor);
+}
+
 } // namespace
@@ -1,14 +1,22 @@
 #pragma once
 
 #include "scdb/reader.h"
+#include "scdb/writer.h"
 
 #include <boost/scoped_ptr.hpp>
 #include <boost/noncopyable.hpp>
 
+namespace marisa {
+class Trie;
+}
+
 namespace scdb {
 
-class MarisaTrieReader : boost::noncopyable,
-                         public Reader
+class PForDelta;
+
+// final, so calls on a MarisaTrieReader rather than a Reader are not virtual
+class MarisaTrieReader final : boost::noncopyable,
+                               public Reader
 {
 public:
     MarisaTrieReader(const Reader::Option& option, const std::string& fname); 
@@ -20,6 +28,101 @@ public:
     virtual std::string GetAsString(const StringPiece& k) const;
 
     virtual std::vector<std::pair<std::string, std::string>> PrefixGet(const StringPiece& prefix, size_t count) const;
+    virtual void PrefixScan(const StringPiece& prefix, const Visitor& visitor) const;
+
+    virtual void MultiGetAsString(const StringPiece* keys, size_t n, std::vector<std::string>* values) const;
+
+    virtual size_t size() const;
+    virtual bool LookupId(const StringPiece& k, uint64_t* id) const;
+    virtual std::string KeyById(uint64_t id) const;
+    virtual std::string GetById(uint64_t id) const;
+
+    // [key] is a prefix of the query, [value] points into the file, or for
+    // compressed, kDFA and kIntMap values into a buffer of the calling
+    // thread, valid until the next call on any reader on this thread.
+    // Return false to stop
+    typedef std::function<bool(const StringPiece& key, const StringPiece& value)> PrefixVisitor;
+
+    // Visit keys which are prefixes of [query] from the shortest, in one walk of the trie
+    void CommonPrefixes(const StringPiece& query, const PrefixVisitor& visitor) const;
+
+    // The longest key which is a prefix of [query], return false if none
+    bool LongestPrefixGet(const StringPiece& query, StringPiece* key, StringPiece* value) const;
+
+    struct FuzzyMatch
+    {
+        std::string key;
+        int distance; // levenshtein distance to the query
+        std::string value; // empty without values
+    };
+
+    // Keys within [max_edits] insertions, deletions or substitutions of
+    // bytes from [query], at most [limit] of the closest ones in order of
+    // distance then key. A file built with_key_order is walked only through
+    // children that exist, any other probes each byte used by its keys
+    std::vector<FuzzyMatch> FuzzySearch(const StringPiece& query, int max_edits, size_t limit,
+                                        bool with_values = false) const;
+
+    virtual uint64_t CountPrefix(const StringPiece& prefix) const;
+
+    // How values are restored, picked from the header once
+    enum ValueKind
+    {
+        kEmptyValue = 0, // kSet
+        kRawValue = 1,
+        kFixedValue = 2,
+        kIntValue = 3,
+        kDFAValue = 4,
+        kCompressedValue = 5,
+        kBlockValue = 6,
+    };
+
+    // Sections of the mapped file a TypedReader reads directly, see
+    // marisa-trie_typed_reader.h. They live as long as the reader
+    struct Sections
+    {
+        ValueKind value_kind;
+        const marisa::Trie* key_trie;
+        const PForDelta* pfd;
+        const char* data_ptr;
+        const int64_t* data_offsets; // offset of values of each key length, NULL if not grouped so
+        bool inline_values; // pfd entries of kPerLengthInlineLayout
+        int value_width; // of kFixedValue
+    };
+
+    Sections sections() const;
+
+    // Keys kept in key order, 0 without a key order section. The [i]-th
+    // key in byte order has id OrderedKeyId(i)
+    uint64_t NumOrderedKeys() const;
+    uint64_t OrderedKeyId(uint64_t i) const;
+    virtual std::vector<std::pair<std::string, float>> TopKPrefix(const StringPiece& prefix, size_t k) const;
+
+    // Values of kFixedLayout are gathered without copying them out one by one
+    virtual void GatherValues(const StringPiece* keys, size_t n, char* out, size_t stride, bool* found) const;
+
+    virtual bool GetInt(const StringPiece& k, uint64_t* v) const;
+    virtual void MultiGetInt(const StringPiece* keys, size_t n, uint64_t* values, bool* found) const;
+
+    // Writer option of the file, block_size is unknown
+    const Writer::Option& writer_option() const;
+
+    // [stored] is a value as in data section, [raw] is false if it should be
+    // uncompressed by codec of compress_type
+    typedef std::function<bool(const StringPiece& key, const StringPiece& stored, bool raw)> StoredVisitor;
+
+    // Visit values of [prefix] without uncompress them, return false if
+    // values are not stored one by one (set, kDFA or block layout)
+    bool PrefixScanStored(const StringPiece& prefix, const StoredVisitor& visitor) const;
+
+    // Value of [id] as stored, [key_length] is length of its key. Return
+    // false if values are not stored one by one, as PrefixScanStored
+    bool GetStoredById(uint64_t id, size_t key_length, StringPiece* stored, bool* raw) const;
+
+    typedef std::function<bool(const StringPiece& key, uint64_t id)> IdVisitor;
+
+    // Visit keys of [prefix] with their ids in trie order, without values
+    void PrefixScanIds(const StringPiece& prefix, const IdVisitor& visitor) const;
 
 private:
     class Impl;
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <string.h>
+
+#include <string>
+#include <stdexcept>
+
+#include "marisa/trie.h"
+
+#include "format.h"
+#include "marisa-trie_reader.h"
+
+#include "utils/varint.h"
+#include "utils/pfordelta.h"
+
+namespace scdb {
+
+// Exist and Get of a MarisaTrieReader with the value kind of the file and
+// the except mode of its pfd fixed at compile time, so a lookup is inlined
+// into the caller, without a call into the reader or a switch per key.
+// Pick the instance once, e.g. by a switch on sections().value_kind and
+// sections().pfd->except_mode(). Values restored by a codec or the value
+// trie are left to MarisaTrieReader::Get
+template <int kKind, PForDelta::ExceptMode kMode>
+class TypedReader
+{
+public:
+    static_assert(kKind == MarisaTrieReader::kEmptyValue || kKind == MarisaTrieReader::kRawValue
+                  || kKind == MarisaTrieReader::kFixedValue || kKind == MarisaTrieReader::kIntValue,
+                  "values of the kind need a codec or the value trie, use MarisaTrieReader::Get");
+
+    // [reader] outlives this, throw if its file is not of [kKind] and [kMode]
+    explicit TypedReader(const MarisaTrieReader& reader)
+        : sections_(reader.sections())
+    {
+        if (sections_.value_kind != kKind || sections_.pfd->except_mode() != kMode)
+        {
+            throw std::invalid_argument("typed reader of value kind " + std::to_string(kKind)
+                                        + " and except mode " + std::to_string(kMode) + " got value kind "
+                                        + std::to_string(sections_.value_kind) + " and except mode "
+                                        + std::to_string(sections_.pfd->except_mode()));
+        }
+    }
+
+    bool Exist(const StringPiece& k) const
+    {
+        auto& agent = ThreadAgent();
+        agent.set_query(k.data(), k.length());
+        return sections_.key_trie->lookup(agent);
+    }
+
+    // As MarisaTrieReader::Get, "" if not found. The value points into the
+    // file, or for inline and kIntValue values into a buffer of the calling
+    // thread, valid until the next call on any reader on this thread
+    StringPiece Get(const StringPiece& k) const
+    {
+        if (kKind == MarisaTrieReader::kEmptyValue)
+            return StringPiece("");
+
+        auto& agent = ThreadAgent();
+        agent.set_query(k.data(), k.length());
+        if (!sections_.key_trie->lookup(agent))
+            return StringPiece("");
+
+        auto id = agent.key().id();
+        if (kKind == MarisaTrieReader::kFixedValue)
+        {
+            auto width = sections_.value_width;
+            return StringPiece(sections_.data_ptr + static_cast<uint64_t>(id) * width, width);
+        }
+
+        auto entry = sections_.pfd->template ExtractAs<kMode>(id);
+        if (kKind == MarisaTrieReader::kIntValue)
+        {
+            static thread_local std::string buf;
+            buf = std::to_string(entry);
+            return StringPiece(buf);
+        }
+
+        return GetRawValue(entry, k.length());
+    }
+
+    // Value of kIntValue, return false if not found
+    bool GetInt(const StringPiece& k, uint64_t* v) const
+    {
+        static_assert(kKind == MarisaTrieReader::kIntValue, "GetInt expects kIntValue");
+
+        auto& agent = ThreadAgent();
+        agent.set_query(k.data(), k.length());
+        if (!sections_.key_trie->lookup(agent))
+            return false;
+
+        *v = sections_.pfd->template ExtractAs<kMode>(agent.key().id());
+        return true;
+    }
+
+private:
+    // [entry] of pfd of a key of length [len], see kPerLengthInlineLayout
+    StringPiece GetRawValue(uint64_t entry, size_t len) const
+    {
+        if (sections_.inline_values)
+        {
+            if (entry & 1)
+            {
+                static thread_local char buf[kMaxInlineValueBytes];
+                uint64_t bytes = entry >> 4;
+                memcpy(buf, &bytes, kMaxInlineValueBytes);
+                return StringPiece(buf, (entry >> 1) & 7);
+            }
+            entry >>= 1;
+        }
+
+        auto p = reinterpret_cast<const int8_t*>(sections_.data_ptr + sections_.data_offsets[len] + entry);
+        size_t prefix_length;
+        auto value_length = DecodeVarint(p, p + 10, &prefix_length);
+        return StringPiece(reinterpret_cast<const char*>(p + prefix_length), value_length);
+    }
+
+    static marisa::Agent& ThreadAgent()
+    {
+        static thread_local marisa::Agent agent;
+        return agent;
+    }
+
+private:
+    MarisaTrieReader::Sections sections_;
+};
+
+} // namespace
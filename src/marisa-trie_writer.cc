@@ -1,40 +1,119 @@
 #include "marisa-trie_writer.h"
 
+#include <errno.h>
+#include <stdlib.h>
+
 #include <cmath>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
 
-#include <snappy.h>
+#include <zdict.h>
+#include <farmhash.h>
 #include <glog/logging.h>
 
+#include "scdb/codec.h"
+
 #include "marisa/trie.h"
 #include "marisa/keyset.h"
 
+#include "format.h"
+
+#include "utils/arena.h"
 #include "utils/varint.h"
 #include "utils/pfordelta.h"
 #include "utils/timestamp.h"
+#include "utils/process_stat.h"
 #include "utils/file_util.h"
+#include "utils/data_spool.h"
+#include "utils/mmap_file.h"
+#include "utils/offset_vector.h"
 #include "utils/file_stream.h"
 
 namespace scdb {
 
-const static char* kVersion = "SCDBV1.";
-
 class MarisaTrieWriter::Impl
 {
 public:
     Impl(const Writer::Option& option, const std::string& fname)
         : option_(option),
           fname_(fname),
-          closed_(false)
+          closed_(false),
+          data_spool_(new DataSpool(option.temp_folder + "data_spool.dat", option.spool_memory_limit)),
+          staging_arena_(new Arena()),
+          num_spooled_keys_(0),
+          pending_offset_(0),
+          has_pending_key_(false),
+          slot_bits_(0),
+          num_records_(0),
+          num_value_refs_(0),
+          dedup_full_(false),
+          dedup_hits_(0),
+          dedup_saved_bytes_(0),
+          sampled_values_(0),
+          sample_bytes_(0),
+          sample_arena_(new Arena()),
+          value_width_(-1),
+          same_width_(true),
+          phase_start_(Timestamp::Now()),
+          phase_start_peak_rss_(PeakRss())
     {
+        if (option_.trie_num_tries < 0 || option_.trie_num_tries > MARISA_MAX_NUM_TRIES)
+        {
+            throw std::invalid_argument("invalid trie num tries " + std::to_string(option_.trie_num_tries));
+        }
+
         if (option_.build_type == kMap)
         {
             if (option_.compress_type == kDFA)
             {
+                // values of kDFA are kept in a keyset, nothing to spool
+                if (option_.sorted_input)
+                {
+                    throw std::invalid_argument("sorted input does not support kDFA");
+                }
                 put_func_ = &Impl::PutAsTrie;
             }
             else
             {
-                put_func_ = &Impl::PutRawOrSnappy;
+                put_func_ = &Impl::PutRawOrCompressed;
+            }
+        }
+        else if (option_.build_type == kIntMap)
+        {
+            // values are kept in the pfd as they are
+            if (option_.compress_type != kNone || option_.block_size > 0)
+            {
+                throw std::invalid_argument("kIntMap does not support compress type or block size");
+            }
+            put_func_ = &Impl::PutIntString;
+        }
+
+        if (option_.value_width != 0 && (option_.value_width < -1 || option_.build_type != kMap
+                                         || option_.compress_type != kNone || option_.block_size > 0))
+        {
+            throw std::invalid_argument("value width expects kMap of kNone without block size");
+        }
+
+        if (option_.inline_value_bytes < 0 || option_.inline_value_bytes > static_cast<int>(kMaxInlineValueBytes)
+            || (option_.inline_value_bytes > 0 && (option_.build_type != kMap || option_.compress_type == kDFA
+                                                   || option_.block_size > 0 || option_.value_width != 0)))
+        {
+            throw std::invalid_argument("inline value bytes expects 0 to 7 for kMap of per length layout");
+        }
+
+        if (option_.compress_type != kNone && option_.compress_type != kDFA && option_.compress_type != kZstdDict)
+        {
+            boost::scoped_ptr<Codec> codec(NewCodec(option_.compress_type, option_.compress_level));
+            if (!codec)
+            {
+                throw std::invalid_argument("unknown compress type " + std::to_string(option_.compress_type));
+            }
+
+            // values are staged raw for blocks, blocks are compressed when close
+            if (option_.block_size == 0)
+            {
+                codec_.swap(codec);
             }
         }
     }
@@ -52,9 +131,8 @@ public:
         if (len == 0)
             return ;
 
-        marisa::Key key;
-        key.set_str(k.data(), len);
-        keys_.push_back(key);
+        CountRecord(0);
+        AddKey(k, 0);
     }
 
     void Put(const StringPiece& k, const StringPiece& v)
@@ -64,8 +142,59 @@ public:
         (this->*put_func_)(k, v);
     }
 
+    void PutInt(const StringPiece& k, uint64_t v)
+    {
+        if (option_.build_type != kIntMap)
+        {
+            throw std::invalid_argument("PutInt expects kIntMap");
+        }
+
+        if (k.length() == 0)
+            return ;
+
+        CountRecord(sizeof v);
+        AddKey(k, v);
+    }
+
+    // value of kIntMap in decimal, as GetAsString() of a reader returns
+    void PutIntString(const StringPiece& k, const StringPiece& v)
+    {
+        std::string s(v.data(), v.length());
+        char* end = NULL;
+        errno = 0;
+        auto n = strtoull(s.c_str(), &end, 10);
+        if (s.empty() || *end != '\0' || errno != 0)
+        {
+            throw std::invalid_argument("invalid integer value '" + s + "' of key " + k.ToString());
+        }
+
+        PutInt(k, n);
+    }
+
+    void PutWeighted(const StringPiece& k, const StringPiece& v, float weight)
+    {
+        // keys are spooled, weights would need their own spool
+        if (option_.sorted_input)
+        {
+            throw std::invalid_argument("sorted input does not support weights");
+        }
+
+        auto n = keys_.size();
+        if (option_.IsNoDataSection())
+            Put(k);
+        else
+            Put(k, v);
+        if (keys_.size() == n)
+            return ;
+
+        weights_.resize(n, 0);
+        weights_.push_back(weight);
+        keys_[n].set_weight(weight);
+    }
+
     void PutAsTrie(const StringPiece& k, const StringPiece& v)
     {
+        CountRecord(v.length());
         marisa::Key key;
         key.set_str(k.data(), k.length());
         keys_.push_back(key);
@@ -75,275 +204,807 @@ public:
         values_.push_back(value);
     }
 
-    void PutRawOrSnappy(const StringPiece& k, const StringPiece& v)
+    void PutRawOrCompressed(const StringPiece& k, const StringPiece& v)
     {
         DCHECK(!option_.IsNoDataSection()) << "Expect Build with value";
 
         auto len = k.length();
         ResizeData(len);
 
-        int64_t data_length = data_lengths_[len];
-        if (EqualLastValue(len, v))
+        CountRecord(v.length());
+        AddKey(k, StageValue(DataBucket(len), v));
+        key_counts_[len]++;
+    }
+
+    // [values] NULL for a set
+    void PutBatch(const StringPiece* keys, const StringPiece* values, size_t n)
+    {
+        if (!values || put_func_ != &Impl::PutRawOrCompressed)
         {
-            data_length -= last_values_lengths_[len];
+            for (size_t i = 0;i < n; i++)
+            {
+                if (values)
+                    Put(keys[i], values[i]);
+                else
+                    Put(keys[i]);
+            }
+            return ;
         }
-        else
+
+        // a batch out of order is rejected before any value is staged
+        if (option_.sorted_input)
         {
-            auto dos = GetDataStream(len);
+            CheckSorted(keys, n);
+        }
 
-            size_t encode_length = 0;
-            size_t value_length = v.length();
-            if (option_.compress_type == kSnappy)
-            {
-                std::string cv;
-                snappy::Compress(v.data(), v.length(), &cv);
-                value_length = cv.length();
+        // values are appended grouped by stream, keys are added in input
+        // order, so duplicated keys and sorted input behave as Put()
+        size_t max_length = 0;
+        for (size_t i = 0;i < n; i++)
+        {
+            max_length = std::max(max_length, keys[i].length());
+        }
+        ResizeData(max_length);
 
-                encode_length = EncodeVarint(value_length, dos);
-                dos->Append(cv);
-            }
-            else
+        batch_starts_.assign(data_lengths_.size() + 1, 0);
+        for (size_t i = 0;i < n; i++)
+        {
+            batch_starts_[DataBucket(keys[i].length()) + 1]++;
+        }
+        for (size_t i = 1;i < batch_starts_.size(); i++)
+        {
+            batch_starts_[i] += batch_starts_[i-1];
+        }
+
+        batch_order_.resize(n);
+        for (size_t i = 0;i < n; i++)
+        {
+            batch_order_[batch_starts_[DataBucket(keys[i].length())]++] = i;
+        }
+
+        batch_offsets_.resize(n);
+        for (auto i : batch_order_)
+        {
+            if (keys[i].length() > 0)
             {
-                encode_length = EncodeVarint(v.length(), dos);
-                dos->Append(v);
+                batch_offsets_[i] = StageValue(DataBucket(keys[i].length()), values[i]);
             }
+        }
 
-            data_lengths_[len] += encode_length + value_length;
+        for (size_t i = 0;i < n; i++)
+        {
+            auto len = keys[i].length();
+            if (len == 0)
+                continue;
 
-            last_values_[len] = v.ToString();
-            last_values_lengths_[len] = value_length + encode_length;
+            CountRecord(values[i].length());
+            AddKey(keys[i], batch_offsets_[i]);
+            key_counts_[len]++;
         }
-
-        marisa::Key key;
-        key.set_str(k.data(), len);
-        keys_.push_back(key);
-        offsets_.push_back(data_length);
-        key_counts_[len]++;
     }
 
-    void Close()
+    void PutStored(const StringPiece& k, const StringPiece& stored, bool raw)
     {
-        if (closed_)
+        DCHECK(put_func_ == &Impl::PutRawOrCompressed && !IsBlockLayout() && option_.compress_type != kZstdDict)
+            << "Expect values compressed one by one";
+
+        auto len = k.length();
+        if (len == 0)
             return ;
+        ResizeData(len);
+
+        CheckValueWidth(stored.length());
 
-        for (size_t i = 0; i < data_streams_.size(); i++)
+        auto bucket = DataBucket(len);
+        // last value of bucket keeps the raw flag at end, it is compared
+        // only to a last value of PutStored, not to a value of Put
+        auto& last = last_values_[bucket];
+        int64_t data_length = data_lengths_[bucket];
+        if (data_spool_->Has(bucket) && last.stored && last.length == stored.length() + 1
+            && last.data[stored.length()] == raw && memcmp(last.data, stored.data(), stored.length()) == 0)
         {
-            if (data_streams_[i])
-            {
-                data_streams_[i]->Close();
-            }
+            data_length -= last.staged_length;
         }
-    
-        std::vector<std::string> files;
+        else
+        {
+            auto dos = GetDataStream(bucket);
+            auto length = codec_ ? AppendEncoded(stored, raw, &dos) : AppendRaw(stored, &dos);
+            data_lengths_[bucket] += length;
 
-        // we must build index first
-        auto key_trie_file = BuildTrie(keys_, "key_trie"); // Must build trie first
-        std::string value_trie_file;
-        if (option_.compress_type == kDFA)
+            auto p = ResetLastValue(bucket, stored.length() + 1, length, true);
+            memcpy(p, stored.data(), stored.length());
+            p[stored.length()] = raw;
+        }
+
+        if (raw && IsInlineValue(stored))
         {
-            value_trie_file = BuildTrie(values_, "value_trie");
+            AddInlineCandidate(bucket, data_length, stored);
         }
 
-        auto pfd_file = BuildPFD();
-        std::string metadata_file = option_.temp_folder + "metadata.dat";
-        WriteMetaData(metadata_file, pfd_file, key_trie_file);
+        CountRecord(stored.length());
+        AddKey(k, StagedEntry(data_length));
+        key_counts_[len]++;
+    }
 
-        files.push_back(metadata_file);
-        if (!pfd_file.empty())
-            files.push_back(pfd_file);
-        files.push_back(key_trie_file); // let trie closed to data, they will mmape together
-        if (!value_trie_file.empty())
-            files.push_back(value_trie_file);
+    // whether [v] may be kept in its pfd entry, it is staged all the same
+    // and BuildPFD inlines it only when the entry widths are known
+    bool IsInlineValue(const StringPiece& v) const
+    {
+        return option_.inline_value_bytes > 0 && v.length() <= static_cast<size_t>(option_.inline_value_bytes);
+    }
 
-        for (auto& file : data_files_)
-        {
-            if (!file.empty())
-            {
-                files.push_back(file);
-            }
-        }
-    
-        MergeFiles(files);
-        if (option_.with_checksum)
+    // Return pfd entry of [v], see kPerLengthInlineLayout
+    uint64_t StageValue(size_t bucket, const StringPiece& v)
+    {
+        auto offset = AppendValue(bucket, v);
+        if (IsInlineValue(v))
         {
-            FileUtil::AddChecksumToFile(fname_);
+            AddInlineCandidate(bucket, offset, v);
         }
 
-        Cleanup(files);
-        closed_ = true;
+        return StagedEntry(offset);
     }
-    
-    void WriteMetaData(const std::string& fname, 
-                       const std::string& pfd_file, 
-                       const std::string& key_trie_file)
+
+    uint64_t StagedEntry(int64_t offset) const
     {
-        FileOutputStream os(fname);
-    
-        // WriteVersion
-        os.Append(kVersion);
-    
-        // Write Time
-        auto now = Timestamp::Now();
-        os.Append(now.MicroSecondsSinceEpoch());
+        return option_.inline_value_bytes > 0 ? offset << 1 : offset;
+    }
 
-        // Write Option
-        os.Append<int8_t>(option_.compress_type);
-        os.Append<int8_t>(option_.build_type);
-        os.Append(option_.with_checksum);
+    static uint64_t InlineEntry(const StringPiece& v)
+    {
+        uint64_t bytes = 0;
+        memcpy(&bytes, v.data(), v.length());
+        return bytes << 4 | v.length() << 1 | 1;
+    }
 
-        if (!option_.IsNoDataSection() && option_.compress_type != kDFA)
-        {
-            os.Append<int32_t>(GetNumKeyCount());
-            os.Append<int32_t>(key_counts_.size()-1);
+    // Remember the inline entry of the value staged at [offset] of [bucket].
+    // Offsets of a bucket only grow, a smaller one is a value staged before
+    void AddInlineCandidate(size_t bucket, int64_t offset, const StringPiece& v)
+    {
+        if (inline_candidates_.size() <= bucket)
+            inline_candidates_.resize(bucket + 1);
 
-            DLOG(INFO) << "num key count " << GetNumKeyCount();
-            DLOG(INFO) << "max key length " << key_counts_.size()-1;
+        auto& candidates = inline_candidates_[bucket];
+        if (candidates.empty() || candidates.back().first < offset)
+            candidates.push_back(std::make_pair(offset, InlineEntry(v)));
+    }
 
-            int64_t data_length = 0;
-            for (size_t i = 0;i < key_counts_.size(); i++)
-            {
-                if (key_counts_[i] <= 0)
-                    continue;
-                os.Append<int32_t>(i);
+    // Return the inline entry of the value staged at [offset] of [bucket], 0 if none
+    uint64_t FindInlineCandidate(size_t bucket, int64_t offset) const
+    {
+        if (inline_candidates_.size() <= bucket)
+            return 0;
 
-                os.Append<int64_t>(data_length);
-                data_length += data_lengths_[i];
-            }
-        }
+        auto& candidates = inline_candidates_[bucket];
+        auto it = std::lower_bound(candidates.begin(), candidates.end(), std::make_pair(offset, uint64_t(0)));
+        return it != candidates.end() && it->first == offset ? it->second : 0;
+    }
 
-        uint64_t pfd_length = 0;
-        if (!pfd_file.empty())
-            FileUtil::GetFileSize(pfd_file, &pfd_length);
+    // Offset of staged value of i-th key
+    int64_t StagedOffset(size_t i) const
+    {
+        return option_.inline_value_bytes == 0 ? offsets_[i] : int_values_[i] >> 1;
+    }
 
-        uint64_t key_trie_length = 0;
-        FileUtil::GetFileSize(key_trie_file, &key_trie_length);
+    void SetStagedOffset(size_t i, int64_t offset)
+    {
+        if (option_.inline_value_bytes == 0)
+            offsets_.set(i, offset);
+        else
+            int_values_[i] = offset << 1;
+    }
 
-        auto index_offset = os.size() + sizeof(int32_t)*2 + sizeof(int64_t);
-        os.Append<int32_t>(index_offset);
-        os.Append<int32_t>(index_offset + pfd_length);
-        os.Append<int64_t>(index_offset + pfd_length + key_trie_length);
+    // pfd entries are kept in 64 bits rather than as 40-bit offsets
+    bool HasWideEntries() const
+    {
+        return option_.build_type == kIntMap || option_.inline_value_bytes > 0;
     }
-    
-    std::string BuildPFD()
+
+    // Return offset of [v] in [bucket]
+    int64_t AppendValue(size_t bucket, const StringPiece& v)
     {
-        if (option_.IsNoDataSection())
-            return "";
+        CheckValueWidth(v.length());
 
-        std::vector<uint64_t> v(keys_.size());
-        if (option_.compress_type == kDFA)
+        int64_t data_length = data_lengths_[bucket];
+        if (EqualLastValue(bucket, v))
         {
-            for (size_t i = 0;i < keys_.size(); i++)
-            {
-                v[keys_[i].id()] = values_[i].id();
-            }
+            data_length -= last_values_[bucket].staged_length;
         }
-        else
+        else if (!FindValue(v, &data_length))
         {
-            for (size_t i = 0;i < keys_.size(); i++)
+            auto dos = GetDataStream(bucket);
+            auto length = codec_ ? AppendCompressed(codec_.get(), v, &dos) : AppendRaw(v, &dos);
+
+            data_lengths_[bucket] += length;
+
+            memcpy(ResetLastValue(bucket, v.length(), length, false), v.data(), v.length());
+
+            RememberValue(v, data_length, length);
+
+            if (option_.compress_type == kZstdDict)
             {
-                v[keys_[i].id()] = offsets_[i];
+                SampleValue(v);
             }
         }
 
-        auto name = option_.temp_folder + "pfd.dat";
-        PForDelta pfd(v);
-        pfd.Save(name);
-        return name;
+        return data_length;
     }
 
-    std::string BuildTrie(marisa::Keyset& s, const std::string& prefix)
+    // [offset] is the value itself for kIntMap, a pfd entry with inline values
+    void AddKey(const StringPiece& k, uint64_t offset)
     {
-        marisa::Trie trie;
-        trie.build(s);
+        if (option_.sorted_input)
+        {
+            SpoolKey(k, offset);
+            return ;
+        }
 
-        std::string fname = option_.temp_folder + prefix + ".dat";
-        trie.save(fname.c_str());
-        return fname;
+        marisa::Key key;
+        key.set_str(k.data(), k.length());
+        keys_.push_back(key);
+        if (HasWideEntries())
+        {
+            int_values_.push_back(offset);
+        }
+        else if (!option_.IsNoDataSection())
+        {
+            offsets_.push_back(offset);
+        }
     }
-  
-    void MergeFiles(const std::vector<std::string>& files)
+
+    // Keys of sorted input are spooled to disk until Close, a duplicated
+    // key is held as pending so only its last offset is written
+    void SpoolKey(const StringPiece& k, uint64_t offset)
     {
-        FileOutputStream os(fname_);
-        for (auto& file : files)
+        if (has_pending_key_)
         {
-            if (!FileUtil::FileExists(file))
+            if (k < pending_key_)
             {
-                LOG(ERROR) << "Skip Merge " << file << " for it not exist";
-                continue;
+                throw std::invalid_argument("input not sorted: " + k.ToString() + " after " + pending_key_);
             }
 
-            uint64_t size = 0;
-            FileUtil::GetFileSize(file, &size);
-            DLOG(INFO) << "Merging " << file << " size=" << size;
-
-            FileUtil::SequentialFile tmp(file);
-            char buf[8192];
-            while (true)
+            if (k != pending_key_)
             {
-                StringPiece fragment;
-                auto status = tmp.Read(sizeof buf, &fragment, buf);
-                if (status)
-                    break;
-
-                if (fragment.empty())
-                    break;
-                os.Append(fragment);
+                FlushPendingKey();
             }
         }
-    }
-    
-    void Cleanup(const std::vector<std::string>& files)
-    {
-        for (auto& file : files)
-        {
-            FileUtil::DeleteFile(file);
-        }
 
-        //FileUtil::DeleteDir(option_.temp_folder);
-        //LOG(INFO) << "DeleteDir " << option_.temp_folder;
+        k.CopyToString(&pending_key_);
+        pending_offset_ = offset;
+        has_pending_key_ = true;
     }
-    
-    void ResizeData(size_t len)
+
+    // Throw as SpoolKey would if [keys] are not sorted after the pending key
+    void CheckSorted(const StringPiece* keys, size_t n) const
     {
-        if (key_counts_.size() <= len)
+        StringPiece last;
+        if (has_pending_key_)
+            last = pending_key_;
+
+        bool has_last = has_pending_key_;
+        for (size_t i = 0;i < n; i++)
         {
-            last_values_.resize(len+1, "");
-            last_values_lengths_.resize(len+1, 0);
+            if (keys[i].empty())
+                continue;
 
-            data_lengths_.resize(len+1, 1);
-            key_counts_.resize(len+1, 0);
+            if (has_last && keys[i] < last)
+            {
+                throw std::invalid_argument("input not sorted: " + keys[i].ToString() + " after " + last.ToString());
+            }
+            last = keys[i];
+            has_last = true;
         }
     }
-    
-    FileOutputStream* GetDataStream(size_t len)
+
+    void FlushPendingKey()
     {
-        if (data_streams_.size() <= len)
+        if (!has_pending_key_)
+            return ;
+
+        if (!key_spool_)
         {
-            data_streams_.resize(len+1, NULL);
-            data_files_.resize(len+1, "");
+            key_spool_file_ = option_.temp_folder + "key_spool.dat";
+            key_spool_.reset(new FileOutputStream(key_spool_file_));
         }
 
-        auto dos = data_streams_[len];
-        if (!dos)
+        EncodeVarint(pending_key_.length(), key_spool_.get());
+        key_spool_->Append(pending_key_);
+        if (!option_.IsNoDataSection())
         {
-            std::string file = option_.temp_folder + "data_" + std::to_string(len) + ".dat";
-            data_files_[len] = file;
-    
-            dos = new FileOutputStream(file);
-            data_streams_[len] = dos;
-            
-            dos->Append('\0');
+            EncodeVarint(pending_offset_, key_spool_.get());
         }
 
-        return dos;
+        num_spooled_keys_++;
+        has_pending_key_ = false;
     }
-    
-    int32_t GetNumKeyCount() const
+
+    // marisa builds the trie from a whole keyset, so all spooled keys are
+    // read back here, memory of Close is as without sorted_input
+    void LoadSpooledKeys()
     {
-        int32_t n = 0;
-        for (auto& k : key_counts_)
+        FlushPendingKey();
+        if (!key_spool_)
+            return ;
+
+        key_spool_.reset();
         {
-            if (k != 0)
+            MmapFile spool(key_spool_file_);
+            CHECK(spool.valid()) << "mmap " << key_spool_file_ << " failed";
+
+            auto p = reinterpret_cast<const int8_t*>(spool.data());
+            auto end = p + spool.size();
+            while (p < end)
+            {
+                size_t prefix_length;
+                auto length = DecodeVarint(p, end, &prefix_length);
+                p += prefix_length;
+
+                marisa::Key key;
+                key.set_str(reinterpret_cast<const char*>(p), length);
+                keys_.push_back(key);
+                p += length;
+
+                if (!option_.IsNoDataSection())
+                {
+                    auto offset = DecodeVarint(p, end, &prefix_length);
+                    p += prefix_length;
+                    if (HasWideEntries())
+                        int_values_.push_back(offset);
+                    else
+                        offsets_.push_back(offset);
+                }
+            }
+        }
+
+        LOG(INFO) << "loaded " << num_spooled_keys_ << " spooled keys";
+        FileUtil::DeleteFile(key_spool_file_);
+    }
+
+    BuildStats Close()
+    {
+        if (closed_)
+            return stats_;
+
+        stats_.num_records = num_records_;
+        ReportStaging();
+        EndPhase("put", 0);
+
+        LayoutData();
+        if (option_.sorted_input)
+        {
+            LoadSpooledKeys();
+            ReportStaging();
+        }
+        EndPhase("layout", DataBytes());
+
+        // kZstdDict stage values raw, its codec is created after dictionary trained
+        if (option_.compress_type == kZstdDict)
+        {
+            TrainDictionary();
+            codec_.reset(NewCodec(kZstdDict, option_.compress_level, dict_));
+            if (option_.block_size == 0)
+            {
+                CompressWithDictionary();
+            }
+            EndPhase("dictionary", DataBytes());
+        }
+        else if (option_.block_size > 0 && option_.compress_type != kDFA)
+        {
+            codec_.reset(NewCodec(option_.compress_type, option_.compress_level));
+        }
+    
+        std::vector<std::string> files;
+
+        // we must build index first
+        auto key_trie_file = BuildTrie(keys_, "key_trie"); // Must build trie first
+        EndPhase("key_trie", FileSize(key_trie_file));
+
+        if (IsFixedLayout())
+        {
+            LayoutFixed();
+            EndPhase("layout_fixed", DataBytes());
+        }
+
+        std::string value_trie_file;
+        if (option_.compress_type == kDFA)
+        {
+            value_trie_file = BuildTrie(values_, "value_trie");
+            EndPhase("value_trie", FileSize(value_trie_file));
+        }
+
+        auto pfd_file = BuildPFD();
+        EndPhase("pfd", pfd_file.empty() ? 0 : FileSize(pfd_file));
+
+        auto key_order_file = BuildKeyOrder();
+        if (!key_order_file.empty())
+        {
+            EndPhase("key_order", FileSize(key_order_file));
+        }
+
+        stats_.data_bytes = value_trie_file.empty() ? DataBytes() : FileSize(value_trie_file);
+
+        std::string metadata_file = option_.temp_folder + "metadata.dat";
+        WriteMetaData(metadata_file, pfd_file, key_trie_file, !key_order_file.empty());
+
+        files.push_back(metadata_file);
+        if (!pfd_file.empty())
+            files.push_back(pfd_file);
+        files.push_back(key_trie_file); // let trie closed to data, they will mmape together
+        if (!value_trie_file.empty())
+            files.push_back(value_trie_file);
+
+        files.insert(files.end(), data_files_.begin(), data_files_.end());
+        if (!key_order_file.empty())
+            files.push_back(key_order_file);
+    
+        MergeFiles(files);
+        EndPhase("merge", FileSize(fname_));
+
+        if (option_.with_checksum)
+        {
+            FileUtil::AddChecksumToFile(fname_);
+            EndPhase("checksum", FileSize(fname_));
+        }
+        stats_.file_bytes = FileSize(fname_);
+
+        Cleanup(files);
+        closed_ = true;
+
+        LOG_IF(INFO, option_.dedup_values) << "dedup " << dedup_hits_ << " values, saved "
+                                           << dedup_saved_bytes_ << " bytes of data section, "
+                                           << num_value_refs_ << " distinct values remembered";
+        LOG(INFO) << "built " << fname_ << ": " << stats_.num_records << " records, "
+                  << static_cast<int64_t>(stats_.RecordsPerSecond()) << " records/s put, "
+                  << stats_.file_bytes << " bytes, compression ratio " << stats_.CompressionRatio();
+        return stats_;
+    }
+
+    // Record the phase ended now, it started at the end of the last one
+    void EndPhase(const std::string& name, int64_t bytes)
+    {
+        auto now = Timestamp::Now();
+
+        BuildStats::Phase phase;
+        phase.name = name;
+        phase.micros = TimeDifference(now, phase_start_);
+        phase.bytes = bytes;
+        phase.peak_rss = PeakRss();
+        phase.peak_rss_growth = phase.peak_rss - phase_start_peak_rss_;
+        stats_.phases.push_back(phase);
+
+        LOG(INFO) << "phase " << name << " use " << phase.micros << " microseconds, "
+                  << bytes << " bytes, peak rss " << phase.peak_rss << " (+" << phase.peak_rss_growth << ")";
+
+        if (option_.progress)
+        {
+            option_.progress(stats_);
+        }
+
+        phase_start_ = Timestamp::Now();
+        phase_start_peak_rss_ = phase.peak_rss;
+    }
+
+    void CountRecord(size_t value_length)
+    {
+        num_records_++;
+        stats_.value_bytes += value_length;
+        stats_.peak_staging_bytes = std::max<int64_t>(stats_.peak_staging_bytes, StagingBytes());
+
+        if (option_.progress && option_.progress_interval > 0 && num_records_ % option_.progress_interval == 0)
+        {
+            stats_.num_records = num_records_;
+            option_.progress(stats_);
+        }
+    }
+
+    // bytes of data section staged so far
+    int64_t DataBytes() const
+    {
+        int64_t bytes = 0;
+        for (auto& file : data_files_)
+        {
+            bytes += FileSize(file);
+        }
+        return bytes;
+    }
+
+    static int64_t FileSize(const std::string& file)
+    {
+        uint64_t size = 0;
+        FileUtil::GetFileSize(file, &size);
+        return size;
+    }
+    
+    void WriteMetaData(const std::string& fname, 
+                       const std::string& pfd_file, 
+                       const std::string& key_trie_file,
+                       bool with_key_order)
+    {
+        FileOutputStream os(fname);
+    
+        // WriteVersion
+        os.Append(VersionTag(kFormatVersion));
+    
+        // Write Time
+        auto now = Timestamp::Now();
+        os.Append(now.MicroSecondsSinceEpoch());
+
+        // Write Option
+        os.Append<int8_t>(option_.compress_type);
+        os.Append<int8_t>(option_.build_type);
+        os.Append(option_.with_checksum);
+
+        if (option_.build_type == kMap && option_.compress_type != kDFA)
+        {
+
+            if (IsBlockLayout())
+            {
+                os.Append<int8_t>(kBlockLayout);
+                os.Append<int32_t>(slot_bits_);
+            }
+            else if (IsFixedLayout())
+            {
+                os.Append<int8_t>(kFixedLayout);
+                os.Append<int32_t>(value_width_);
+            }
+            else
+            {
+                os.Append<int8_t>(option_.inline_value_bytes > 0 ? kPerLengthInlineLayout : kPerLengthLayout);
+                WriteDataOffsets(os);
+            }
+
+            if (option_.compress_type == kZstdDict)
+            {
+                os.Append<int32_t>(dict_.size());
+                os.Append(dict_);
+            }
+        }
+
+        uint64_t pfd_length = 0;
+        if (!pfd_file.empty())
+            FileUtil::GetFileSize(pfd_file, &pfd_length);
+
+        uint64_t key_trie_length = 0;
+        FileUtil::GetFileSize(key_trie_file, &key_trie_length);
+
+        int64_t index_offset = os.size() + sizeof(int64_t)*4;
+        os.Append<int64_t>(index_offset);
+        os.Append<int64_t>(index_offset + pfd_length);
+        os.Append<int64_t>(index_offset + pfd_length + key_trie_length);
+        os.Append<int64_t>(with_key_order ? index_offset + pfd_length + key_trie_length + stats_.data_bytes : 0);
+    }
+    
+    void WriteDataOffsets(FileOutputStream& os)
+    {
+        os.Append<int32_t>(GetNumKeyCount());
+        os.Append<int32_t>(key_counts_.size()-1);
+
+        DLOG(INFO) << "num key count " << GetNumKeyCount();
+        DLOG(INFO) << "max key length " << key_counts_.size()-1;
+
+        for (size_t i = 0;i < key_counts_.size(); i++)
+        {
+            if (!HasData(i))
+                continue;
+            os.Append<int32_t>(i);
+            os.Append<int64_t>(bucket_offsets_[DataBucket(i)]);
+        }
+    }
+
+    std::string BuildPFD()
+    {
+        if (option_.IsNoDataSection() || IsFixedLayout())
+            return "";
+
+        // duplicated keys share one id
+        size_t num_keys = 0;
+        for (size_t i = 0;i < keys_.size(); i++)
+        {
+            num_keys = std::max(num_keys, keys_[i].id() + 1);
+        }
+
+        std::vector<uint64_t> v(std::max<size_t>(num_keys, 1)); // PForDelta needs one value at least
+        if (option_.compress_type == kDFA)
+        {
+            for (size_t i = 0;i < keys_.size(); i++)
+            {
+                v[keys_[i].id()] = values_[i].id();
+            }
+        }
+        else if (HasWideEntries())
+        {
+            for (size_t i = 0;i < keys_.size(); i++)
+            {
+                v[keys_[i].id()] = int_values_[i];
+            }
+            InlineValues(&v);
+        }
+        else if (IsBlockLayout())
+        {
+            BuildBlocks(&v);
+        }
+        else
+        {
+            for (size_t i = 0;i < keys_.size(); i++)
+            {
+                v[keys_[i].id()] = offsets_[i];
+            }
+        }
+
+        auto name = option_.temp_folder + "pfd.dat";
+        PForDelta pfd(v);
+        pfd.Save(name);
+        return name;
+    }
+
+    std::string BuildTrie(marisa::Keyset& s, const std::string& prefix)
+    {
+        auto flags = TrieFlags(option_.trie_num_tries, option_.trie_cache_level);
+        if (option_.trie_auto_tune)
+        {
+            flags = TuneTrie(s, prefix);
+        }
+
+        marisa::Trie trie;
+        trie.build(s, flags);
+
+        std::string fname = option_.temp_folder + prefix + ".dat";
+        trie.save(fname.c_str());
+        return fname;
+    }
+  
+    int TrieFlags(int num_tries, Writer::TrieCacheLevel cache_level) const
+    {
+        static const int kCacheLevels[] = {0, MARISA_HUGE_CACHE, MARISA_LARGE_CACHE, MARISA_NORMAL_CACHE,
+                                           MARISA_SMALL_CACHE, MARISA_TINY_CACHE};
+        static const int kTailModes[] = {0, MARISA_TEXT_TAIL, MARISA_BINARY_TAIL};
+        static const int kNodeOrders[] = {0, MARISA_LABEL_ORDER, MARISA_WEIGHT_ORDER};
+
+        return num_tries | kCacheLevels[cache_level] | kTailModes[option_.trie_tail_mode]
+               | kNodeOrders[option_.trie_node_order];
+    }
+
+    // Build candidates on a strided sample of [s], score each by trie size
+    // times time to look up every sampled key, return flags of the lowest
+    int TuneTrie(marisa::Keyset& s, const std::string& prefix)
+    {
+        auto flags = TrieFlags(option_.trie_num_tries, option_.trie_cache_level);
+        if (s.size() == 0 || option_.trie_tune_sample == 0)
+            return flags;
+
+        marisa::Keyset sample;
+        size_t step = std::max<size_t>(1, s.size() / option_.trie_tune_sample);
+        for (size_t i = 0;i < s.size(); i += step)
+        {
+            sample.push_back(s[i].ptr(), s[i].length());
+        }
+
+        static const int kNumTries[] = {1, 2, 3, 4, 5};
+        static const Writer::TrieCacheLevel kCacheLevels[] = {kHugeCache, kLargeCache, kNormalCache, kSmallCache, kTinyCache};
+
+        double best_score = 0;
+        int best_num_tries = 0;
+        int best_cache_level = 0;
+        marisa::Agent agent;
+        for (auto num_tries : kNumTries)
+        {
+            for (auto cache_level : kCacheLevels)
+            {
+                auto candidate = TrieFlags(num_tries, cache_level);
+                marisa::Trie trie;
+                trie.build(sample, candidate);
+
+                // best of two rounds, the first one warms up the cache
+                int64_t micros = 0;
+                for (int round = 0;round < 2; round++)
+                {
+                    auto start = Timestamp::Now();
+                    for (size_t i = 0;i < sample.size(); i++)
+                    {
+                        agent.set_query(sample[i].ptr(), sample[i].length());
+                        trie.lookup(agent);
+                    }
+                    auto elapsed = std::max<int64_t>(1, TimeDifference(Timestamp::Now(), start));
+                    micros = round == 0 ? elapsed : std::min(micros, elapsed);
+                }
+
+                double score = static_cast<double>(trie.io_size()) * micros;
+                DLOG(INFO) << prefix << " num_tries=" << num_tries << " cache_level=" << cache_level
+                           << " size=" << trie.io_size() << " lookup=" << micros << "us";
+                if (best_score == 0 || score < best_score)
+                {
+                    best_score = score;
+                    flags = candidate;
+                    best_num_tries = num_tries;
+                    best_cache_level = cache_level;
+                }
+            }
+        }
+
+        LOG(INFO) << prefix << " tuned on " << sample.size() << " keys: num_tries=" << best_num_tries
+                  << " cache_level=" << best_cache_level;
+        return flags;
+    }
+
+    void MergeFiles(const std::vector<std::string>& files)
+    {
+        FileOutputStream os(fname_);
+        for (auto& file : files)
+        {
+            if (!FileUtil::FileExists(file))
+            {
+                LOG(ERROR) << "Skip Merge " << file << " for it not exist";
+                continue;
+            }
+
+            uint64_t size = 0;
+            FileUtil::GetFileSize(file, &size);
+            DLOG(INFO) << "Merging " << file << " size=" << size;
+
+            FileUtil::SequentialFile tmp(file);
+            char buf[8192];
+            while (true)
+            {
+                StringPiece fragment;
+                auto status = tmp.Read(sizeof buf, &fragment, buf);
+                if (status)
+                    break;
+
+                if (fragment.empty())
+                    break;
+                os.Append(fragment);
+            }
+        }
+    }
+    
+    void Cleanup(const std::vector<std::string>& files)
+    {
+        for (auto& file : files)
+        {
+            FileUtil::DeleteFile(file);
+        }
+
+        //FileUtil::DeleteDir(option_.temp_folder);
+        //LOG(INFO) << "DeleteDir " << option_.temp_folder;
+    }
+    
+    void ResizeData(size_t len)
+    {
+        if (key_counts_.size() <= len)
+        {
+            last_values_.resize(len+1);
+
+            data_lengths_.resize(len+1, 1);
+            key_counts_.resize(len+1, 0);
+        }
+    }
+    
+    DataSpool::Stream GetDataStream(size_t bucket)
+    {
+        auto dos = data_spool_->GetStream(bucket);
+        if (!data_spool_->Has(bucket))
+        {
+            dos.Append('\0');
+        }
+        return dos;
+    }
+
+    // all buckets are staged in one spool, lay them out contiguously into one data file
+    void LayoutData()
+    {
+        std::string file = option_.temp_folder + "data.dat";
+        if (data_spool_->Finish(file, &bucket_offsets_))
+        {
+            data_files_.push_back(file);
+        }
+    }
+    
+    int32_t GetNumKeyCount() const
+    {
+        int32_t n = 0;
+        for (size_t i = 0;i < key_counts_.size(); i++)
+        {
+            if (HasData(i))
             {
                 n++;
             }
@@ -351,14 +1012,549 @@ public:
         return n;
     }
 
-    bool EqualLastValue(size_t len, const StringPiece& v) const
+    // whether keys of length [len] have values in data section
+    bool HasData(size_t len) const
+    {
+        return key_counts_[len] > 0 && data_spool_->Has(DataBucket(len));
+    }
+
+    bool IsBlockLayout() const
+    {
+        return option_.build_type == kMap && option_.block_size > 0 && option_.compress_type != kDFA;
+    }
+
+    // Sort key ids by key, with weights build the max tree of them over
+    // the ids. Return "" if key order is not kept
+    std::string BuildKeyOrder()
+    {
+        if (keys_.empty() || (weights_.empty() && !option_.with_key_order))
+            return "";
+
+        size_t num_keys = 0;
+        for (size_t i = 0;i < keys_.size(); i++)
+        {
+            num_keys = std::max(num_keys, keys_[i].id() + 1);
+        }
+
+        // duplicated keys share one id, the last one wins
+        std::vector<uint32_t> key_index(num_keys, 0);
+        std::vector<float> weights(num_keys, 0);
+        for (size_t i = 0;i < keys_.size(); i++)
+        {
+            key_index[keys_[i].id()] = i;
+            weights[keys_[i].id()] = i < weights_.size() ? weights_[i] : 0;
+        }
+
+        std::vector<uint32_t> ids(num_keys);
+        for (size_t id = 0;id < num_keys; id++)
+        {
+            ids[id] = id;
+        }
+        std::sort(ids.begin(), ids.end(), [&](uint32_t a, uint32_t b) {
+            auto& ka = keys_[key_index[a]];
+            auto& kb = keys_[key_index[b]];
+            return StringPiece(ka.ptr(), ka.length()) < StringPiece(kb.ptr(), kb.length());
+        });
+
+        std::string fname = option_.temp_folder + "key_order.dat";
+        FileOutputStream os(fname);
+        os.Append<uint64_t>(num_keys);
+        os.Append<uint64_t>(weights_.empty() ? 0 : kWithWeights);
+        os.Append(StringPiece(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(uint32_t)));
+        if (weights_.empty())
+            return fname;
+
+        std::vector<float> tree(num_keys * 2, 0);
+        for (size_t i = 0;i < num_keys; i++)
+        {
+            tree[num_keys + i] = weights[ids[i]];
+        }
+        for (size_t i = num_keys - 1;i > 0; i--)
+        {
+            tree[i] = std::max(tree[2*i], tree[2*i+1]);
+        }
+        os.Append(StringPiece(reinterpret_cast<const char*>(tree.data()), tree.size() * sizeof(float)));
+        return fname;
+    }
+
+    // Values of a key length are checked against value_width when they
+    // are staged, the layout is decided when close
+    void CheckValueWidth(size_t length)
+    {
+        if (option_.value_width > 0 && length != static_cast<size_t>(option_.value_width))
+        {
+            throw std::invalid_argument("value of " + std::to_string(length) + " bytes, expect "
+                                        + std::to_string(option_.value_width));
+        }
+
+        if (value_width_ < 0)
+            value_width_ = length;
+        else if (static_cast<size_t>(value_width_) != length)
+            same_width_ = false;
+    }
+
+    bool IsFixedLayout() const
+    {
+        return option_.value_width != 0 && same_width_ && value_width_ > 0;
+    }
+
+    // Copy staged values into key id order without their length prefixes,
+    // the data section replaces the pfd then
+    void LayoutFixed()
+    {
+        size_t num_keys = 0;
+        for (size_t i = 0;i < keys_.size(); i++)
+        {
+            num_keys = std::max(num_keys, keys_[i].id() + 1);
+        }
+
+        // duplicated keys share one id, the last one wins
+        std::vector<uint32_t> key_index(num_keys, 0);
+        for (size_t i = 0;i < keys_.size(); i++)
+        {
+            key_index[keys_[i].id()] = i;
+        }
+
+        std::string file = option_.temp_folder + "fixed.dat";
+        {
+            MmapFile staged(data_files_[0]);
+            CHECK(staged.valid()) << "mmap " << data_files_[0] << " failed";
+
+            FileOutputStream dos(file);
+            for (size_t id = 0;id < num_keys; id++)
+            {
+                auto i = key_index[id];
+                auto bucket = DataBucket(keys_[i].length());
+                auto begin = reinterpret_cast<const int8_t*>(staged.data()) + bucket_offsets_[bucket];
+                auto value = begin + offsets_[i];
+
+                size_t prefix_length;
+                DecodeVarint(value, begin + data_lengths_[bucket], &prefix_length);
+                dos.Append(StringPiece(reinterpret_cast<const char*>(value + prefix_length), value_width_));
+            }
+        }
+
+        LOG(INFO) << num_keys << " values of " << value_width_ << " bytes laid out in key id order";
+        FileUtil::DeleteFile(data_files_[0]);
+        data_files_[0] = file;
+    }
+
+    // Lay staged values out in key id order, group them into blocks of about
+    // block_size bytes, a block is compressed as a whole. Adjacent keys with
+    // the same staged value share a slot. [v] keep block << slot_bits | slot
+    void BuildBlocks(std::vector<uint64_t>* v)
     {
-        if (data_streams_.size() <= len || data_streams_[len] == NULL || key_counts_[len] == 0 || last_values_lengths_[len] != static_cast<int32_t>(v.length()))
+        std::vector<uint32_t> key_index(v->size(), 0);
+        for (size_t i = 0;i < keys_.size(); i++)
+        {
+            key_index[keys_[i].id()] = i;
+        }
+
+        boost::scoped_ptr<MmapFile> staged;
+        if (!data_files_.empty())
+        {
+            staged.reset(new MmapFile(data_files_[0]));
+            CHECK(staged->valid()) << "mmap " << data_files_[0] << " failed";
+        }
+
+        std::string blocks_file = option_.temp_folder + "blocks.dat";
+        std::vector<uint64_t> block_offsets(1, 0);
+        {
+            FileOutputStream dos(blocks_file);
+
+            std::string block;
+            uint32_t num_slots = 0;
+            uint32_t max_slots = 0;
+            const int8_t* last_value = NULL;
+            auto num_keys = keys_.empty() ? 0 : v->size();
+            for (size_t id = 0;id < num_keys; id++)
+            {
+                auto i = key_index[id];
+                auto bucket = DataBucket(keys_[i].length());
+                auto begin = reinterpret_cast<const int8_t*>(staged->data()) + bucket_offsets_[bucket];
+                auto value = begin + offsets_[i];
+
+                if (value != last_value)
+                {
+                    size_t prefix_length;
+                    auto value_length = DecodeVarint(value, begin + data_lengths_[bucket], &prefix_length);
+                    auto entry_length = prefix_length + value_length;
+                    if (num_slots > 0 && (block.length() + entry_length > option_.block_size || num_slots == kMaxBlockSlots))
+                    {
+                        block_offsets.push_back(block_offsets.back() + FlushBlock(&block, &dos));
+                        num_slots = 0;
+                    }
+
+                    block.append(reinterpret_cast<const char*>(value), entry_length);
+                    num_slots++;
+                    max_slots = std::max(max_slots, num_slots);
+                    last_value = value;
+                }
+
+                (*v)[id] = (static_cast<uint64_t>(block_offsets.size() - 1) << 32) | (num_slots - 1);
+            }
+
+            if (num_slots > 0)
+            {
+                block_offsets.push_back(block_offsets.back() + FlushBlock(&block, &dos));
+            }
+
+            slot_bits_ = max_slots > 1 ? BitsOf(max_slots - 1) : 0;
+        }
+
+        for (auto& e : *v)
+        {
+            e = ((e >> 32) << slot_bits_) | (e & 0xffffffff);
+        }
+
+        std::string index_file = option_.temp_folder + "block_index.dat";
+        {
+            FileOutputStream dos(index_file);
+            dos.Append<uint64_t>(block_offsets.size() - 1);
+            for (auto offset : block_offsets)
+            {
+                dos.Append<uint64_t>(offset);
+            }
+        }
+
+        LOG(INFO) << block_offsets.size() - 1 << " blocks, " << block_offsets.back() << " bytes, "
+                  << slot_bits_ << " bits of slot";
+
+        staged.reset();
+        for (auto& file : data_files_)
+        {
+            FileUtil::DeleteFile(file);
+        }
+        data_files_.clear();
+        data_files_.push_back(index_file);
+        data_files_.push_back(blocks_file);
+    }
+
+    template<typename Stream>
+    size_t FlushBlock(std::string* block, Stream* dos)
+    {
+        auto length = codec_ ? AppendCompressed(codec_.get(), *block, dos) : AppendRaw(*block, dos);
+        block->clear();
+        return length;
+    }
+
+    // The pfd is one frame over all keys, its width is known only after
+    // staging. A short value is kept in its entry if that is no wider than
+    // the widest offset entry, so inlining never widens the frame and the
+    // result does not depend on the order of Put
+    void InlineValues(std::vector<uint64_t>* v) const
+    {
+        if (option_.inline_value_bytes == 0 || inline_candidates_.empty())
+            return ;
+
+        uint32_t width = 0;
+        for (auto entry : *v)
+        {
+            width = std::max(width, BitsOf(entry));
+        }
+
+        size_t num_inline = 0;
+        for (size_t i = 0;i < keys_.size(); i++)
+        {
+            auto& entry = (*v)[keys_[i].id()];
+            if (entry != int_values_[i])
+                continue; // a later duplicated key took the id
+
+            auto inline_entry = FindInlineCandidate(DataBucket(keys_[i].length()), StagedOffset(i));
+            if (inline_entry != 0 && BitsOf(inline_entry) <= width)
+            {
+                entry = inline_entry;
+                num_inline++;
+            }
+        }
+        LOG(INFO) << num_inline << " values inline in pfd entries of " << width << " bits";
+    }
+
+    static uint32_t BitsOf(uint64_t n)
+    {
+        uint32_t bits = 0;
+        for (; n; n >>= 1)
+            bits++;
+        return bits;
+    }
+
+    template<typename Stream>
+    size_t AppendRaw(const StringPiece& v, Stream* dos)
+    {
+        auto encode_length = EncodeVarint(v.length(), dos);
+        dos->Append(v);
+        return encode_length + v.length();
+    }
+
+    // lowest bit of length prefix is a raw flag, a value stay raw if codec can not make it smaller
+    template<typename Stream>
+    size_t AppendCompressed(const Codec* codec, const StringPiece& v, Stream* dos)
+    {
+        bool raw = !codec->Compress(v, &cv_) || cv_.length() >= v.length();
+        return AppendEncoded(raw ? v : StringPiece(cv_), raw, dos);
+    }
+
+    template<typename Stream>
+    size_t AppendEncoded(const StringPiece& stored, bool raw, Stream* dos)
+    {
+        auto encode_length = EncodeVarint((stored.length() << 1) | raw, dos);
+        dos->Append(stored);
+        return encode_length + stored.length();
+    }
+
+    // all values share bucket 0 when dedup across key lengths, keys never have length 0
+    size_t DataBucket(size_t len) const
+    {
+        return option_.dedup_values ? 0 : len;
+    }
+
+    // reservoir sampling, keep about kDictSampleRatio times of dictionary size
+    void SampleValue(const StringPiece& v)
+    {
+        sampled_values_++;
+        if (sample_bytes_ < option_.zstd_dict_size * kDictSampleRatio)
+        {
+            samples_.push_back(sample_arena_->Copy(v));
+            sample_bytes_ += v.length();
+            return ;
+        }
+
+        std::uniform_int_distribution<int64_t> dist(0, sampled_values_-1);
+        auto i = dist(rng_);
+        if (i < static_cast<int64_t>(samples_.size()))
+        {
+            sample_bytes_ += v.length() - samples_[i].length();
+            samples_[i] = sample_arena_->Copy(v);
+
+            // replaced samples are garbage in arena, copy live ones to a new arena
+            if (sample_arena_->MemoryUsage() > 2 * option_.zstd_dict_size * kDictSampleRatio)
+            {
+                boost::scoped_ptr<Arena> arena(new Arena());
+                for (auto& s : samples_)
+                {
+                    s = arena->Copy(s);
+                }
+                sample_arena_.swap(arena);
+            }
+        }
+    }
+
+    void TrainDictionary()
+    {
+        if (samples_.empty())
+            return ;
+
+        std::string samples;
+        std::vector<size_t> sizes;
+        samples.reserve(sample_bytes_);
+        for (auto& s : samples_)
+        {
+            s.AppendToString(&samples);
+            sizes.push_back(s.length());
+        }
+        std::vector<StringPiece>().swap(samples_);
+        sample_arena_.reset(new Arena());
+
+        dict_.resize(option_.zstd_dict_size);
+        auto n = ZDICT_trainFromBuffer(&dict_[0], dict_.size(), samples.data(), &sizes[0], sizes.size());
+        if (ZDICT_isError(n))
+        {
+            LOG(WARNING) << "train zstd dictionary failed: " << ZDICT_getErrorName(n) << ", compress without dictionary";
+            dict_.clear();
+            return ;
+        }
+        dict_.resize(n);
+        LOG(INFO) << "zstd dictionary " << n << " bytes trained from " << sizes.size() << " samples";
+    }
+
+    // values are staged raw, compress each bucket of the data file with the
+    // trained dictionary, then move offsets to the compressed one
+    void CompressWithDictionary()
+    {
+        if (data_files_.empty())
+            return ;
+
+        // (raw offset, compressed offset) of each bucket, in ascending order
+        std::vector<std::vector<std::pair<int64_t, int64_t>>> remaps(bucket_offsets_.size());
+        std::string file = option_.temp_folder + "data.zst.dat";
+        {
+            MmapFile raw(data_files_[0]);
+            CHECK(raw.valid()) << "mmap " << data_files_[0] << " failed";
+
+            FileOutputStream dos(file);
+            for (size_t i = 0; i < bucket_offsets_.size(); i++)
+            {
+                if (bucket_offsets_[i] < 0)
+                    continue;
+
+                auto bucket_offset = dos.size();
+                dos.Append('\0');
+
+                auto data = raw.data() + bucket_offsets_[i];
+                auto begin = reinterpret_cast<const int8_t*>(data);
+                auto end = begin + data_lengths_[i];
+                int64_t offset = 1;
+                int64_t data_length = 1;
+                while (begin + offset < end)
+                {
+                    size_t prefix_length;
+                    auto value_length = DecodeVarint(begin + offset, end, &prefix_length);
+                    StringPiece value(data + offset + prefix_length, value_length);
+
+                    remaps[i].push_back(std::make_pair(offset, data_length));
+                    data_length += AppendCompressed(codec_.get(), value, &dos);
+
+                    offset += prefix_length + value_length;
+                }
+
+                DLOG(INFO) << "data of bucket " << i << " compressed " << data_lengths_[i] << " -> " << data_length;
+                data_lengths_[i] = data_length;
+                bucket_offsets_[i] = bucket_offset;
+            }
+        }
+
+        FileUtil::DeleteFile(data_files_[0]);
+        data_files_[0] = file;
+
+        for (size_t i = 0; i < keys_.size(); i++)
+        {
+            auto offset = StagedOffset(i);
+            auto& remap = remaps[DataBucket(keys_[i].length())];
+            auto it = std::lower_bound(remap.begin(), remap.end(), std::make_pair(offset, int64_t(0)));
+            DCHECK(it != remap.end() && it->first == offset) << "Unknown offset " << offset;
+            SetStagedOffset(i, it->second);
+        }
+
+        for (size_t i = 0; i < inline_candidates_.size(); i++)
+        {
+            auto& remap = remaps[i];
+            for (auto& candidate : inline_candidates_[i])
+            {
+                auto it = std::lower_bound(remap.begin(), remap.end(), std::make_pair(candidate.first, int64_t(0)));
+                DCHECK(it != remap.end() && it->first == candidate.first) << "Unknown offset " << candidate.first;
+                candidate.first = it->second;
+            }
+        }
+    }
+
+    bool EqualLastValue(size_t bucket, const StringPiece& v) const
+    {
+        auto& last = last_values_[bucket];
+        if (!data_spool_->Has(bucket) || last.stored || last.length != v.length())
         {
             return false;
         }
 
-        return strncmp(v.data(), last_values_[len].data(), v.length()) == 0;
+        return memcmp(v.data(), last.data, v.length()) == 0;
+    }
+
+    // Room for a last value of [length] bytes in [bucket], staged as
+    // [staged_length] bytes. The slot of a bucket is reused while a value
+    // fits, a longer one takes a new slot of twice the size in the arena
+    char* ResetLastValue(size_t bucket, size_t length, int32_t staged_length, bool stored)
+    {
+        auto& last = last_values_[bucket];
+        if (length > last.capacity)
+        {
+            last.capacity = std::max(std::max(length, 2 * last.capacity), size_t(kMinLastValueBytes));
+            last.data = staging_arena_->Allocate(last.capacity);
+        }
+        last.length = length;
+        last.staged_length = staged_length;
+        last.stored = stored;
+        return last.data;
+    }
+
+    // lookup a value written before, fingerprint128 make a false match practically impossible
+    bool FindValue(const StringPiece& v, int64_t* offset)
+    {
+        if (!option_.dedup_values)
+            return false;
+
+        auto fp = util::Fingerprint128(v.data(), v.length());
+        auto& ref = value_refs_[FindValueSlot(util::Uint128Low64(fp), util::Uint128High64(fp))];
+        if (ref.length < 0)
+            return false;
+
+        *offset = ref.offset;
+        dedup_hits_++;
+        dedup_saved_bytes_ += ref.length;
+        return true;
+    }
+
+    // linear probing, return the empty slot if not found
+    size_t FindValueSlot(uint64_t key, uint64_t fingerprint)
+    {
+        if (value_refs_.empty())
+        {
+            value_refs_.resize(kMinValueRefs);
+        }
+
+        size_t mask = value_refs_.size() - 1;
+        for (size_t i = key & mask; ; i = (i + 1) & mask)
+        {
+            auto& ref = value_refs_[i];
+            if (ref.length < 0 || (ref.key == key && ref.fingerprint == fingerprint))
+                return i;
+        }
+    }
+
+    void RememberValue(const StringPiece& v, int64_t offset, int32_t length)
+    {
+        if (!option_.dedup_values || dedup_full_)
+            return ;
+
+        // keep load factor under 1/2
+        if ((num_value_refs_ + 1) * 2 > value_refs_.size())
+        {
+            auto size = std::max<size_t>(value_refs_.size() * 2, size_t(kMinValueRefs));
+            if (size * sizeof(ValueRef) > option_.dedup_memory_limit)
+            {
+                LOG(WARNING) << "dedup table reach memory limit " << option_.dedup_memory_limit
+                             << " bytes, new values will not be deduplicated";
+                dedup_full_ = true;
+                return ;
+            }
+
+            std::vector<ValueRef> refs(size);
+            refs.swap(value_refs_);
+            for (auto& ref : refs)
+            {
+                if (ref.length >= 0)
+                    value_refs_[FindValueSlot(ref.key, ref.fingerprint)] = ref;
+            }
+        }
+
+        auto fp = util::Fingerprint128(v.data(), v.length());
+        auto& ref = value_refs_[FindValueSlot(util::Uint128Low64(fp), util::Uint128High64(fp))];
+        ref.key = util::Uint128Low64(fp);
+        ref.fingerprint = util::Uint128High64(fp);
+        ref.offset = offset;
+        ref.length = length;
+        num_value_refs_++;
+    }
+
+    // Approximate heap bytes held for the build before Close, cheap enough
+    // to be sampled after each record
+    size_t StagingBytes() const
+    {
+        return keys_.total_length() + keys_.size() * sizeof(marisa::Key)
+               + values_.total_length() + values_.size() * sizeof(marisa::Key)
+               + offsets_.memory_usage() + int_values_.capacity() * sizeof(uint64_t)
+               + weights_.capacity() * sizeof(float)
+               + value_refs_.capacity() * sizeof(ValueRef)
+               + sample_arena_->MemoryUsage() + samples_.capacity() * sizeof(StringPiece)
+               + staging_arena_->MemoryUsage() + last_values_.capacity() * sizeof(LastValue)
+               + data_spool_->memory_usage();
+    }
+
+    void ReportStaging()
+    {
+        auto bytes = StagingBytes();
+        stats_.peak_staging_bytes = std::max<int64_t>(stats_.peak_staging_bytes, bytes);
+        LOG(INFO) << "staging " << bytes << " bytes for " << num_records_ << " records, peak "
+                  << stats_.peak_staging_bytes << " bytes, " << static_cast<int64_t>(stats_.StagingBytesPerRecord())
+                  << " bytes per record";
     }
 
 private:
@@ -369,16 +1565,98 @@ private:
     marisa::Keyset keys_;
     marisa::Keyset values_;
 
-    std::vector<std::string> data_files_;
-    std::vector<FileOutputStream*> data_streams_;
+    std::vector<std::string> data_files_; // data section, merged in order
+    boost::scoped_ptr<DataSpool> data_spool_;
+    std::vector<int64_t> bucket_offsets_; // offset of each bucket in data file, -1 if empty
 
     std::vector<int64_t> data_lengths_;
     std::vector<int32_t> key_counts_;
 
-    std::vector<std::string> last_values_;
-    std::vector<int32_t> last_values_lengths_;
+    struct LastValue
+    {
+        LastValue()
+            : data(NULL),
+              length(0),
+              capacity(0),
+              staged_length(0),
+              stored(false)
+        {}
+
+        char* data; // in staging_arena_
+        size_t length;
+        size_t capacity;
+        int32_t staged_length; // bytes of it in data section
+        bool stored; // of PutStored, stored bytes and raw flag
+    };
+
+    std::vector<LastValue> last_values_; // of each bucket
+    static const size_t kMinLastValueBytes = 32;
+    boost::scoped_ptr<Arena> staging_arena_; // slots of last values
+
+    OffsetVector offsets_; // offset of value in its bucket
+    std::vector<uint64_t> int_values_; // values of kIntMap, or pfd entries with inline values
+    std::vector<std::vector<std::pair<int64_t, uint64_t>>> inline_candidates_; // (staged offset, inline entry) of short values of each bucket
+    std::vector<float> weights_; // of keys_ up to the last one put with weight
+
+    // sorted input
+    std::string key_spool_file_;
+    boost::scoped_ptr<FileOutputStream> key_spool_;
+    int64_t num_spooled_keys_;
+    std::string pending_key_;
+    int64_t pending_offset_;
+    bool has_pending_key_;
+
+    boost::scoped_ptr<Codec> codec_;
+    std::string cv_; // compress buffer
+
+    static const uint32_t kMaxBlockSlots = 1 << 16;
+    uint32_t slot_bits_;
+
+    int64_t num_records_;
+
+    // open addressing table of values written, keyed by fingerprint128
+    struct ValueRef
+    {
+        ValueRef()
+            : key(0),
+              fingerprint(0),
+              offset(0),
+              length(-1)
+        {}
+
+        uint64_t key; // low 64 bits
+        uint64_t fingerprint; // high 64 bits
+        int64_t offset;
+        int32_t length; // < 0 for an empty slot
+    };
+    static const size_t kMinValueRefs = 1024;
+
+    std::vector<ValueRef> value_refs_;
+    size_t num_value_refs_;
+    bool dedup_full_;
+    int64_t dedup_hits_;
+    int64_t dedup_saved_bytes_;
 
-    std::vector<uint32_t> offsets_;
+    // sample of values to train zstd dictionary
+    static const size_t kDictSampleRatio = 100;
+    std::vector<StringPiece> samples_; // in sample_arena_
+    int64_t sampled_values_;
+    size_t sample_bytes_;
+    boost::scoped_ptr<Arena> sample_arena_;
+    std::mt19937_64 rng_;
+    std::string dict_;
+
+    int64_t value_width_; // length of the first value
+    bool same_width_; // all values have length value_width_
+
+    // buffers of PutBatch
+    std::vector<size_t> batch_starts_;
+    std::vector<size_t> batch_order_;
+    std::vector<int64_t> batch_offsets_;
+
+    BuildStats stats_;
+    Timestamp phase_start_;
+    int64_t phase_start_peak_rss_;
 
     typedef void (Impl::*PutFunc)(const StringPiece&, const StringPiece&);
     PutFunc put_func_;
@@ -403,9 +1681,29 @@ void MarisaTrieWriter::Put(const StringPiece& k, const StringPiece& v)
     impl_->Put(k, v);
 }
 
-void MarisaTrieWriter::Close()
+void MarisaTrieWriter::PutInt(const StringPiece& k, uint64_t v)
+{
+    impl_->PutInt(k, v);
+}
+
+void MarisaTrieWriter::PutWeighted(const StringPiece& k, const StringPiece& v, float weight)
+{
+    impl_->PutWeighted(k, v, weight);
+}
+
+void MarisaTrieWriter::PutStored(const StringPiece& k, const StringPiece& stored, bool raw)
+{
+    impl_->PutStored(k, stored, raw);
+}
+
+void MarisaTrieWriter::PutBatch(const StringPiece* keys, const StringPiece* values, size_t n)
+{
+    impl_->PutBatch(keys, values, n);
+}
+
+BuildStats MarisaTrieWriter::Close()
 {
-    impl_->Close();
+    return impl_->Close();
 }
 
 } // namespace
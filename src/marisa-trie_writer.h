@@ -16,7 +16,15 @@ public:
 
     virtual void Put(const StringPiece& k);
     virtual void Put(const StringPiece& k, const StringPiece& v);
-    virtual void Close();
+    virtual void PutInt(const StringPiece& k, uint64_t v);
+    virtual void PutWeighted(const StringPiece& k, const StringPiece& v, float weight);
+    virtual void PutBatch(const StringPiece* keys, const StringPiece* values, size_t n);
+    virtual BuildStats Close();
+
+    // Put a value as stored by a MarisaTrieReader::PrefixScanStored() of the
+    // same compress type, it is copied without uncompress and compress.
+    // Not for kDFA, kZstdDict and block layout
+    void PutStored(const StringPiece& k, const StringPiece& stored, bool raw);
 
 private:
     class Impl;
@@ -1,10 +1,25 @@
 #include "scdb/scdb.h"
 
+#include <queue>
+#include <memory>
 #include <fstream>
+#include <algorithm>
 
+#include <boost/scoped_ptr.hpp>
+
+#include "format.h"
+#include "delta_writer.h"
+#include "layered_reader.h"
+#include "sharded_reader.h"
+#include "sharded_writer.h"
 #include "marisa-trie_reader.h"
 #include "marisa-trie_writer.h"
 
+#include "utils/varint.h"
+#include "utils/mmap_file.h"
+#include "utils/file_util.h"
+#include "utils/file_stream.h"
+
 #include <glog/logging.h>
 
 namespace scdb {
@@ -17,11 +32,13 @@ Reader* CreateReader(const Reader::Option& option, const std::string& input)
         return NULL;
     }
 
-    char buf[7];
+    char buf[kMaxVersionTagLength];
     is.read(buf, sizeof buf);
+    StringPiece tag(buf, is.gcount());
     is.close();
 
-    if (strncmp(buf, "SCDBV1.", 7))
+    bool sharded = tag.starts_with(StringPiece(kShardManifestTag, kVersionTagLength));
+    if (!sharded && !ParseVersionTag(tag))
     {
         return NULL;
     }
@@ -29,7 +46,10 @@ Reader* CreateReader(const Reader::Option& option, const std::string& input)
     Reader* reader =  NULL;
     try
     {
-        reader = new MarisaTrieReader(option, input);
+        if (sharded)
+            reader = new ShardedReader(option, input);
+        else
+            reader = new MarisaTrieReader(option, input);
     }
     catch (const std::exception& e)
     {
@@ -41,7 +61,297 @@ Reader* CreateReader(const Reader::Option& option, const std::string& input)
 
 Writer* CreateWriter(const Writer::Option& option, const std::string& output)
 {
+    if (option.num_shards > 1)
+        return new ShardedWriter(option, output);
     return new MarisaTrieWriter(option, output);
 }
 
+Writer* CreateDeltaWriter(const Writer::Option& option, const std::string& output)
+{
+    return new DeltaWriter(option, output);
+}
+
+Reader* CreateLayeredReader(const Reader::Option& option, const std::string& base, const std::vector<std::string>& deltas)
+{
+    Reader* reader = NULL;
+    try
+    {
+        reader = new LayeredReader(option, base, deltas);
+    }
+    catch (const std::exception& e)
+    {
+        DLOG(ERROR) << "make layered reader failed: " << e.what();
+    }
+
+    return reader;
+}
+
+bool CompactLayers(const Writer::Option& option, const std::string& base, const std::vector<std::string>& deltas, const std::string& output)
+{
+    try
+    {
+        LayeredReader reader(Reader::Option(), base, deltas);
+        boost::scoped_ptr<Writer> writer(CreateWriter(option, output));
+        reader.PrefixScan("", [&](const StringPiece& k, const std::string& v) {
+            if (option.IsNoDataSection())
+                writer->Put(k);
+            else
+                writer->Put(k, v);
+            return true;
+        });
+        writer->Close();
+    }
+    catch (const std::exception& e)
+    {
+        LOG(ERROR) << "compact into " << output << " failed: " << e.what();
+        return false;
+    }
+
+    return true;
+}
+
+namespace {
+
+// whether stored values of [input] can be copied to writer of [output] as is
+bool CanCopyStored(const Writer::Option& input, const Writer::Option& output)
+{
+    return input.compress_type == output.compress_type
+        && output.build_type == Writer::kMap
+        && output.compress_type != Writer::kDFA
+        && output.compress_type != Writer::kZstdDict // dictionary is trained per file
+        && output.block_size == 0;
+}
+
+// Keys of an input in byte order with their ids
+class KeySource
+{
+public:
+    virtual ~KeySource() {}
+
+    // Return false at end, [key] is valid until the next call
+    virtual bool Next(StringPiece* key, uint64_t* id) = 0;
+};
+
+// Keys of an input built with key order, reverse looked up by id
+class OrderedKeySource : public KeySource
+{
+public:
+    explicit OrderedKeySource(const MarisaTrieReader* reader)
+        : reader_(reader),
+          pos_(0)
+    {}
+
+    virtual bool Next(StringPiece* key, uint64_t* id)
+    {
+        if (pos_ >= reader_->NumOrderedKeys())
+            return false;
+
+        *id = reader_->OrderedKeyId(pos_++);
+        key_ = reader_->KeyById(*id);
+        *key = key_;
+        return true;
+    }
+
+private:
+    const MarisaTrieReader* reader_;
+    uint64_t pos_;
+    std::string key_;
+};
+
+// A run of sorted keys spilled to [fname] as varint length, key and
+// varint id, the file is deleted with the source
+class RunKeySource : public KeySource
+{
+public:
+    explicit RunKeySource(const std::string& fname)
+        : fname_(fname),
+          file_(new MmapFile(fname))
+    {
+        CHECK(file_->valid()) << "mmap " << fname << " failed";
+        p_ = reinterpret_cast<const int8_t*>(file_->data());
+        end_ = p_ + file_->size();
+    }
+
+    virtual ~RunKeySource()
+    {
+        file_.reset();
+        FileUtil::DeleteFile(fname_);
+    }
+
+    virtual bool Next(StringPiece* key, uint64_t* id)
+    {
+        if (p_ >= end_)
+            return false;
+
+        size_t prefix_length;
+        auto length = DecodeVarint(p_, end_, &prefix_length);
+        p_ += prefix_length;
+        *key = StringPiece(reinterpret_cast<const char*>(p_), length);
+        p_ += length;
+        *id = DecodeVarint(p_, end_, &prefix_length);
+        p_ += prefix_length;
+        return true;
+    }
+
+private:
+    std::string fname_;
+    boost::scoped_ptr<MmapFile> file_;
+    const int8_t* p_;
+    const int8_t* end_;
+};
+
+// Sort keys of [reader] in runs of about [memory_limit] bytes, each
+// spilled to a file named [prefix] and its number
+void SpillRuns(const MarisaTrieReader& reader, const std::string& prefix, size_t memory_limit,
+               std::vector<std::unique_ptr<KeySource>>* sources)
+{
+    std::vector<std::pair<std::string, uint64_t>> run;
+    size_t run_bytes = 0;
+    size_t num_runs = 0;
+    auto flush = [&]() {
+        if (run.empty())
+            return ;
+
+        std::sort(run.begin(), run.end());
+        auto fname = prefix + std::to_string(num_runs++);
+        {
+            FileOutputStream os(fname);
+            for (auto& e : run)
+            {
+                EncodeVarint(e.first.length(), &os);
+                os.Append(e.first);
+                EncodeVarint(e.second, &os);
+            }
+        }
+        sources->emplace_back(new RunKeySource(fname));
+        run.clear();
+        run_bytes = 0;
+    };
+
+    reader.PrefixScanIds("", [&](const StringPiece& k, uint64_t id) {
+        run.push_back(std::make_pair(k.ToString(), id));
+        run_bytes += sizeof run.back() + k.length();
+        if (run_bytes >= memory_limit)
+            flush();
+        return true;
+    });
+    flush();
+}
+
+} // namespace
+
+bool Merge(const Writer::Option& option, const std::vector<std::string>& inputs, const std::string& output, MergePolicy policy)
+{
+    try
+    {
+        std::vector<std::unique_ptr<MarisaTrieReader>> readers;
+        std::vector<bool> copy_stored;
+        for (auto& input : inputs)
+        {
+            readers.emplace_back(new MarisaTrieReader(Reader::Option(), input));
+            copy_stored.push_back(CanCopyStored(readers.back()->writer_option(), option));
+        }
+
+        // keys of each input in byte order, from its key order section, or
+        // merged from sorted runs of spool_memory_limit bytes
+        std::vector<std::unique_ptr<KeySource>> sources;
+        std::vector<size_t> input_of; // input of each source
+        for (size_t i = 0;i < readers.size(); i++)
+        {
+            if (readers[i]->NumOrderedKeys() > 0)
+            {
+                sources.emplace_back(new OrderedKeySource(readers[i].get()));
+            }
+            else
+            {
+                SpillRuns(*readers[i], option.temp_folder + "merge_run." + std::to_string(i) + ".",
+                          option.spool_memory_limit, &sources);
+            }
+            input_of.resize(sources.size(), i);
+        }
+
+        // k-way merge of the sources, (key, source) pops in key order and
+        // among equal keys in input order, a source has a key once
+        struct Head
+        {
+            StringPiece key;
+            uint64_t id;
+            size_t source;
+        };
+        auto greater = [&input_of](const Head& a, const Head& b) {
+            return b.key < a.key || (a.key == b.key && input_of[b.source] < input_of[a.source]);
+        };
+        std::priority_queue<Head, std::vector<Head>, decltype(greater)> heads(greater);
+        auto advance = [&](size_t s) {
+            Head head;
+            head.source = s;
+            if (sources[s]->Next(&head.key, &head.id))
+                heads.push(head);
+        };
+        for (size_t s = 0;s < sources.size(); s++)
+        {
+            advance(s);
+        }
+
+        // keys come sorted, so the writer spools them instead of holding
+        // them until Close, but for kDFA which does not take sorted input
+        Writer::Option merged_option(option);
+        merged_option.sorted_input = option.compress_type != Writer::kDFA;
+        MarisaTrieWriter writer(merged_option, output);
+
+        int64_t num_copied = 0;
+        int64_t num_put = 0;
+        int64_t num_dropped = 0;
+        std::vector<Head> same; // heads of one key, advanced after it is written
+        while (!heads.empty())
+        {
+            same.clear();
+            same.push_back(heads.top());
+            heads.pop();
+            while (!heads.empty() && heads.top().key == same[0].key)
+            {
+                same.push_back(heads.top());
+                heads.pop();
+            }
+            num_dropped += same.size() - 1;
+
+            auto& winner = policy == kLastWins ? same.back() : same.front();
+            auto i = input_of[winner.source];
+            auto& reader = readers[i];
+            StringPiece stored;
+            bool raw;
+            if (copy_stored[i] && reader->GetStoredById(winner.id, winner.key.length(), &stored, &raw))
+            {
+                writer.PutStored(winner.key, stored, raw);
+                num_copied++;
+            }
+            else
+            {
+                if (option.IsNoDataSection())
+                    writer.Put(winner.key);
+                else
+                    writer.Put(winner.key, reader->GetById(winner.id));
+                num_put++;
+            }
+
+            for (auto& head : same)
+            {
+                advance(head.source);
+            }
+        }
+        writer.Close();
+
+        LOG(INFO) << "merged " << inputs.size() << " files of " << sources.size() << " key sources into " << output
+                  << ", " << num_copied << " values copied, " << num_put << " values rebuilt, "
+                  << num_dropped << " duplicated keys dropped";
+    }
+    catch (const std::exception& e)
+    {
+        LOG(ERROR) << "merge into " << output << " failed: " << e.what();
+        return false;
+    }
+
+    return true;
+}
+
 } // namespace
@@ -0,0 +1,179 @@
+#include "sharded_reader.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "format.h"
+#include "marisa-trie_reader.h"
+
+#include "utils/file_stream.h"
+
+namespace scdb {
+
+ShardedReader::ShardedReader(const Reader::Option& option, const std::string& fname)
+{
+    FileInputStream is(fname);
+
+    char buf[kVersionTagLength];
+    is.Read(buf, sizeof buf);
+    if (memcmp(buf, kShardManifestTag, sizeof buf) != 0)
+    {
+        throw std::runtime_error("invalid shard manifest " + fname);
+    }
+
+    auto dir = fname.substr(0, fname.find_last_of('/') + 1);
+    auto num_shards = is.Read<int32_t>();
+    if (num_shards < 1)
+    {
+        throw std::runtime_error("invalid num shards " + std::to_string(num_shards) + " of " + fname);
+    }
+
+    for (int32_t i = 0;i < num_shards; i++)
+    {
+        std::vector<char> name(is.Read<int32_t>());
+        if (name.empty() || is.Read(name) != name.size())
+        {
+            throw std::runtime_error("truncated shard manifest " + fname);
+        }
+
+        shards_.emplace_back(new MarisaTrieReader(option, dir + std::string(name.begin(), name.end())));
+    }
+
+    id_bases_.push_back(0);
+    for (auto& shard : shards_)
+    {
+        id_bases_.push_back(id_bases_.back() + shard->size());
+    }
+
+    DLOG(INFO) << "loaded " << num_shards << " shards of " << fname;
+}
+
+ShardedReader::~ShardedReader()
+{
+}
+
+const Reader* ShardedReader::Shard(const StringPiece& k) const
+{
+    return shards_[ShardOf(k, shards_.size())].get();
+}
+
+bool ShardedReader::Exist(const StringPiece& k) const
+{
+    return Shard(k)->Exist(k);
+}
+
+StringPiece ShardedReader::Get(const StringPiece& k) const
+{
+    return Shard(k)->Get(k);
+}
+
+std::string ShardedReader::GetAsString(const StringPiece& k) const
+{
+    return Shard(k)->GetAsString(k);
+}
+
+bool ShardedReader::GetInt(const StringPiece& k, uint64_t* v) const
+{
+    return Shard(k)->GetInt(k, v);
+}
+
+size_t ShardedReader::size() const
+{
+    return id_bases_.back();
+}
+
+bool ShardedReader::LookupId(const StringPiece& k, uint64_t* id) const
+{
+    auto shard = ShardOf(k, shards_.size());
+    if (!shards_[shard]->LookupId(k, id))
+        return false;
+
+    *id += id_bases_[shard];
+    return true;
+}
+
+size_t ShardedReader::ShardOfId(uint64_t* id) const
+{
+    if (*id >= size())
+    {
+        throw std::out_of_range("key id " + std::to_string(*id) + " out of range " + std::to_string(size()));
+    }
+
+    size_t shard = std::upper_bound(id_bases_.begin(), id_bases_.end(), *id) - id_bases_.begin() - 1;
+    *id -= id_bases_[shard];
+    return shard;
+}
+
+std::string ShardedReader::KeyById(uint64_t id) const
+{
+    auto shard = ShardOfId(&id);
+    return shards_[shard]->KeyById(id);
+}
+
+std::string ShardedReader::GetById(uint64_t id) const
+{
+    auto shard = ShardOfId(&id);
+    return shards_[shard]->GetById(id);
+}
+
+std::vector<std::pair<std::string, std::string>> ShardedReader::PrefixGet(const StringPiece& prefix, size_t count) const
+{
+    std::vector<std::pair<std::string, std::string>> m;
+    for (auto& shard : shards_)
+    {
+        if (m.size() >= count)
+            break;
+
+        auto part = shard->PrefixGet(prefix, count - m.size());
+        m.insert(m.end(), part.begin(), part.end());
+    }
+    return m;
+}
+
+void ShardedReader::PrefixScan(const StringPiece& prefix, const Visitor& visitor) const
+{
+    bool stopped = false;
+    for (auto& shard : shards_)
+    {
+        shard->PrefixScan(prefix, [&](const StringPiece& k, const std::string& v) {
+            stopped = !visitor(k, v);
+            return !stopped;
+        });
+
+        if (stopped)
+            break;
+    }
+}
+
+uint64_t ShardedReader::CountPrefix(const StringPiece& prefix) const
+{
+    uint64_t n = 0;
+    for (auto& shard : shards_)
+    {
+        n += shard->CountPrefix(prefix);
+    }
+    return n;
+}
+
+// top k of each shard, then the top k of them
+std::vector<std::pair<std::string, float>> ShardedReader::TopKPrefix(const StringPiece& prefix, size_t k) const
+{
+    std::vector<std::pair<std::string, float>> top;
+    for (auto& shard : shards_)
+    {
+        auto part = shard->TopKPrefix(prefix, k);
+        top.insert(top.end(), part.begin(), part.end());
+    }
+
+    std::stable_sort(top.begin(), top.end(), [](const std::pair<std::string, float>& a, const std::pair<std::string, float>& b) {
+        return a.second > b.second;
+    });
+    if (top.size() > k)
+        top.resize(k);
+    return top;
+}
+
+} // namespace
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "scdb/reader.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+namespace scdb {
+
+// Reader of a dataset built by ShardedWriter, a key is looked up in its
+// shard only, prefix queries go to all shards
+class ShardedReader : boost::noncopyable,
+                      public Reader
+{
+public:
+    // [fname] is the manifest
+    ShardedReader(const Reader::Option& option, const std::string& fname);
+    virtual ~ShardedReader();
+
+    virtual bool Exist(const StringPiece& k) const;
+
+    virtual StringPiece Get(const StringPiece& k) const;
+    virtual std::string GetAsString(const StringPiece& k) const;
+    virtual bool GetInt(const StringPiece& k, uint64_t* v) const;
+
+    // id of a key is its id in its shard plus keys of shards before
+    virtual size_t size() const;
+    virtual bool LookupId(const StringPiece& k, uint64_t* id) const;
+    virtual std::string KeyById(uint64_t id) const;
+    virtual std::string GetById(uint64_t id) const;
+
+    virtual std::vector<std::pair<std::string, std::string>> PrefixGet(const StringPiece& prefix, size_t count) const;
+    virtual void PrefixScan(const StringPiece& prefix, const Visitor& visitor) const;
+    virtual uint64_t CountPrefix(const StringPiece& prefix) const;
+    virtual std::vector<std::pair<std::string, float>> TopKPrefix(const StringPiece& prefix, size_t k) const;
+
+private:
+    const Reader* Shard(const StringPiece& k) const;
+
+    // Return shard of [id], [id] becomes id in the shard
+    size_t ShardOfId(uint64_t* id) const;
+
+    std::vector<std::unique_ptr<Reader>> shards_;
+    std::vector<uint64_t> id_bases_; // first id of each shard, and size() at end
+};
+
+} // namespace
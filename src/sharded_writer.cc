@@ -0,0 +1,174 @@
+#include "sharded_writer.h"
+
+#include <thread>
+#include <algorithm>
+#include <exception>
+
+#include <glog/logging.h>
+
+#include "format.h"
+#include "marisa-trie_writer.h"
+
+#include "utils/file_util.h"
+#include "utils/file_stream.h"
+
+namespace scdb {
+
+ShardedWriter::ShardedWriter(const Writer::Option& option, const std::string& fname)
+    : option_(option),
+      fname_(fname),
+      closed_(false)
+{
+    if (option_.num_shards < 1)
+    {
+        throw std::invalid_argument("invalid num shards " + std::to_string(option_.num_shards));
+    }
+
+    // temp files of a MarisaTrieWriter have fixed names, each shard has its own folder
+    for (int i = 0;i < option_.num_shards; i++)
+    {
+        auto shard_option = option_;
+        shard_option.num_shards = 1;
+        if (option_.progress)
+        {
+            // shards are closed in parallel, progress of each shard is reported in turn
+            shard_option.progress = [this](const BuildStats& stats) {
+                std::lock_guard<std::mutex> lock(progress_mutex_);
+                option_.progress(stats);
+            };
+        }
+        shard_option.temp_folder = option_.temp_folder + "shard_" + std::to_string(i) + "/";
+        if (!FileUtil::FileExists(shard_option.temp_folder))
+        {
+            FileUtil::CreateDir(shard_option.temp_folder);
+        }
+
+        shard_files_.push_back(fname_ + "." + std::to_string(i));
+        temp_folders_.push_back(shard_option.temp_folder);
+        writers_.emplace_back(new MarisaTrieWriter(shard_option, shard_files_.back()));
+    }
+}
+
+ShardedWriter::~ShardedWriter()
+{
+    try
+    {
+        Close();
+    }
+    catch (const std::exception& e)
+    {
+        LOG(ERROR) << "close " << fname_ << " failed: " << e.what();
+    }
+}
+
+void ShardedWriter::Put(const StringPiece& k)
+{
+    writers_[ShardOf(k, writers_.size())]->Put(k);
+}
+
+void ShardedWriter::Put(const StringPiece& k, const StringPiece& v)
+{
+    writers_[ShardOf(k, writers_.size())]->Put(k, v);
+}
+
+void ShardedWriter::PutInt(const StringPiece& k, uint64_t v)
+{
+    writers_[ShardOf(k, writers_.size())]->PutInt(k, v);
+}
+
+void ShardedWriter::PutWeighted(const StringPiece& k, const StringPiece& v, float weight)
+{
+    writers_[ShardOf(k, writers_.size())]->PutWeighted(k, v, weight);
+}
+
+BuildStats ShardedWriter::Close()
+{
+    if (closed_)
+        return stats_;
+    closed_ = true;
+
+    std::vector<std::exception_ptr> errors(writers_.size());
+    std::vector<BuildStats> stats(writers_.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0;i < writers_.size(); i++)
+    {
+        threads.emplace_back([this, i, &errors, &stats]() {
+            try
+            {
+                stats[i] = writers_[i]->Close();
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (auto& folder : temp_folders_)
+    {
+        FileUtil::DeleteDir(folder);
+    }
+
+    for (auto& error : errors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    WriteManifest();
+
+    stats_ = MergeStats(stats);
+    return stats_;
+}
+
+// Shards run in parallel, a phase takes as long as its slowest shard
+BuildStats ShardedWriter::MergeStats(const std::vector<BuildStats>& stats)
+{
+    BuildStats merged;
+    for (auto& s : stats)
+    {
+        merged.num_records += s.num_records;
+        merged.value_bytes += s.value_bytes;
+        merged.data_bytes += s.data_bytes;
+        merged.file_bytes += s.file_bytes;
+        merged.peak_staging_bytes += s.peak_staging_bytes; // shards stage at the same time
+
+        for (auto& phase : s.phases)
+        {
+            auto it = std::find_if(merged.phases.begin(), merged.phases.end(), [&](const BuildStats::Phase& p) {
+                return p.name == phase.name;
+            });
+            if (it == merged.phases.end())
+            {
+                merged.phases.push_back(phase);
+                continue;
+            }
+
+            it->micros = std::max(it->micros, phase.micros);
+            it->bytes += phase.bytes;
+            it->peak_rss = std::max(it->peak_rss, phase.peak_rss);
+            it->peak_rss_growth = std::max(it->peak_rss_growth, phase.peak_rss_growth);
+        }
+    }
+    return merged;
+}
+
+void ShardedWriter::WriteManifest()
+{
+    FileOutputStream os(fname_);
+    os.Append(kShardManifestTag);
+    os.Append<int32_t>(shard_files_.size());
+    for (auto& file : shard_files_)
+    {
+        auto name = file.substr(file.find_last_of('/') + 1);
+        os.Append<int32_t>(name.length());
+        os.Append(name);
+    }
+}
+
+} // namespace
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "scdb/writer.h"
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+namespace scdb {
+
+// Partition keys by ShardOf() into Option::num_shards MarisaTrieWriters,
+// shards are closed in parallel, then a manifest is written to [fname]
+class ShardedWriter : boost::noncopyable,
+                      public Writer
+{
+public:
+    ShardedWriter(const Writer::Option& option, const std::string& fname);
+    virtual ~ShardedWriter();
+
+    virtual void Put(const StringPiece& k);
+    virtual void Put(const StringPiece& k, const StringPiece& v);
+    virtual void PutInt(const StringPiece& k, uint64_t v);
+    virtual void PutWeighted(const StringPiece& k, const StringPiece& v, float weight);
+    virtual BuildStats Close();
+
+private:
+    void WriteManifest();
+    static BuildStats MergeStats(const std::vector<BuildStats>& stats);
+
+    Writer::Option option_;
+    std::string fname_;
+    bool closed_;
+
+    std::vector<std::string> shard_files_;
+    std::vector<std::string> temp_folders_;
+    std::vector<std::unique_ptr<Writer>> writers_;
+
+    std::mutex progress_mutex_;
+    BuildStats stats_;
+};
+
+} // namespace
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "scdb/string_piece.h"
+
+namespace scdb {
+
+// Bump allocator in the way of leveldb, memory is released when the arena
+// is destroyed. Small allocations share 64 KB blocks
+class Arena : boost::noncopyable
+{
+public:
+    Arena()
+        : alloc_ptr_(NULL),
+          alloc_bytes_remaining_(0),
+          memory_usage_(0)
+    {}
+
+    ~Arena()
+    {
+        for (auto block : blocks_)
+        {
+            delete [] block;
+        }
+    }
+
+    char* Allocate(size_t bytes)
+    {
+        if (bytes <= alloc_bytes_remaining_)
+        {
+            auto result = alloc_ptr_;
+            alloc_ptr_ += bytes;
+            alloc_bytes_remaining_ -= bytes;
+            return result;
+        }
+        return AllocateFallback(bytes);
+    }
+
+    // Copy of [s] owned by arena
+    StringPiece Copy(const StringPiece& s)
+    {
+        if (s.empty())
+            return StringPiece();
+
+        auto p = Allocate(s.length());
+        memcpy(p, s.data(), s.length());
+        return StringPiece(p, s.length());
+    }
+
+    // bytes of all blocks
+    size_t MemoryUsage() const
+    {
+        return memory_usage_ + blocks_.capacity() * sizeof(char*);
+    }
+
+private:
+    char* AllocateFallback(size_t bytes)
+    {
+        // large object is allocated alone, not to waste the rest of current block
+        if (bytes > kBlockSize / 4)
+        {
+            return AllocateNewBlock(bytes);
+        }
+
+        alloc_ptr_ = AllocateNewBlock(kBlockSize);
+        alloc_bytes_remaining_ = kBlockSize;
+
+        auto result = alloc_ptr_;
+        alloc_ptr_ += bytes;
+        alloc_bytes_remaining_ -= bytes;
+        return result;
+    }
+
+    char* AllocateNewBlock(size_t block_bytes)
+    {
+        auto result = new char[block_bytes];
+        blocks_.push_back(result);
+        memory_usage_ += block_bytes;
+        return result;
+    }
+
+    static const size_t kBlockSize = 64 << 10;
+
+    char* alloc_ptr_;
+    size_t alloc_bytes_remaining_;
+    std::vector<char*> blocks_;
+    size_t memory_usage_;
+};
+
+} // namespace
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+#include <algorithm>
+
+#include <farmhash.h>
+
+#include "scdb/string_piece.h"
+
+namespace scdb {
+
+// In memory bloom filter of 64-bit key hashes, probes are derived by double hashing
+class BloomFilter
+{
+public:
+    BloomFilter(size_t num_keys, size_t bits_per_key = 10)
+        : num_bits_(std::max<uint64_t>(num_keys * bits_per_key, 64)),
+          num_probes_(std::max<uint32_t>(1, bits_per_key * 69 / 100)) // ln2 * bits_per_key
+    {
+        bits_.resize((num_bits_ + 63) / 64, 0);
+    }
+
+    static uint64_t Hash(const StringPiece& key)
+    {
+        return util::Hash64(key.data(), key.length());
+    }
+
+    void Add(uint64_t h)
+    {
+        auto delta = (h >> 33) | (h << 31);
+        for (uint32_t i = 0;i < num_probes_; i++)
+        {
+            auto bit = h % num_bits_;
+            bits_[bit >> 6] |= 1ull << (bit & 63);
+            h += delta;
+        }
+    }
+
+    bool MayContain(uint64_t h) const
+    {
+        auto delta = (h >> 33) | (h << 31);
+        for (uint32_t i = 0;i < num_probes_; i++)
+        {
+            auto bit = h % num_bits_;
+            if (!(bits_[bit >> 6] & (1ull << (bit & 63))))
+                return false;
+            h += delta;
+        }
+        return true;
+    }
+
+private:
+    uint64_t num_bits_;
+    uint32_t num_probes_;
+    std::vector<uint64_t> bits_;
+};
+
+} // namespace
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <glog/logging.h>
+
+#include "utils/file_util.h"
+#include "utils/mmap_file.h"
+#include "utils/file_stream.h"
+
+namespace scdb {
+
+// Staging of the data of many buckets in one append only temp file. Data of
+// each bucket is buffered in memory, when buffers of all buckets exceed the
+// memory limit the largest one is spilled to the spool file as a segment of
+// its bucket. Finish() lays buckets out contiguously in bucket order
+class DataSpool : boost::noncopyable
+{
+public:
+    // Appends to one bucket, works with EncodeVarint like a FileOutputStream
+    class Stream
+    {
+    public:
+        Stream(DataSpool* spool, size_t bucket)
+            : spool_(spool),
+              bucket_(bucket)
+        {}
+
+        void Append(const int8_t* buf, size_t n)
+        {
+            spool_->Append(bucket_, StringPiece(reinterpret_cast<const char*>(buf), n));
+        }
+
+        void Append(const StringPiece& v)
+        {
+            spool_->Append(bucket_, v);
+        }
+
+        void Append(char c)
+        {
+            spool_->Append(bucket_, StringPiece(&c, 1));
+        }
+
+    private:
+        DataSpool* spool_;
+        size_t bucket_;
+    };
+
+    DataSpool(const std::string& fname, size_t memory_limit)
+        : fname_(fname),
+          memory_limit_(memory_limit),
+          buffered_bytes_(0),
+          memory_usage_(0),
+          num_spills_(0)
+    {}
+
+    ~DataSpool()
+    {
+        if (spool_)
+        {
+            spool_.reset();
+            FileUtil::DeleteFile(fname_);
+        }
+    }
+
+    Stream GetStream(size_t bucket)
+    {
+        return Stream(this, bucket);
+    }
+
+    bool Has(size_t bucket) const
+    {
+        return bucket < buckets_.size() && buckets_[bucket].length > 0;
+    }
+
+    // bytes appended to [bucket]
+    uint64_t size(size_t bucket) const
+    {
+        return bucket < buckets_.size() ? buckets_[bucket].length : 0;
+    }
+
+    void Append(size_t bucket, const StringPiece& data)
+    {
+        if (buckets_.size() <= bucket)
+        {
+            memory_usage_ -= buckets_.capacity() * sizeof(Bucket);
+            buckets_.resize(bucket+1);
+            memory_usage_ += buckets_.capacity() * sizeof(Bucket);
+        }
+
+        auto& b = buckets_[bucket];
+        auto capacity = b.buffer.capacity();
+        b.buffer.append(data.data(), data.length());
+        b.length += data.length();
+        memory_usage_ += b.buffer.capacity() - capacity;
+
+        buffered_bytes_ += data.length();
+        if (buffered_bytes_ > memory_limit_)
+        {
+            Spill();
+        }
+    }
+
+    // Write all buckets to [fname] in bucket order, [offsets] is the offset
+    // of each bucket in it, -1 for an empty bucket. Return false if no data
+    bool Finish(const std::string& fname, std::vector<int64_t>* offsets)
+    {
+        offsets->assign(buckets_.size(), -1);
+
+        bool has_data = false;
+        for (auto& b : buckets_)
+        {
+            has_data = has_data || b.length > 0;
+        }
+        if (!has_data)
+            return false;
+
+        spool_.reset();
+        boost::scoped_ptr<MmapFile> spool;
+        if (num_spills_ > 0)
+        {
+            spool.reset(new MmapFile(fname_));
+            CHECK(spool->valid()) << "mmap " << fname_ << " failed";
+        }
+
+        FileOutputStream os(fname);
+        for (size_t i = 0;i < buckets_.size(); i++)
+        {
+            auto& b = buckets_[i];
+            if (b.length == 0)
+                continue;
+
+            (*offsets)[i] = os.size();
+            for (auto& segment : b.segments)
+            {
+                os.Append(StringPiece(spool->data() + segment.first, segment.second));
+            }
+            os.Append(b.buffer);
+
+            std::string().swap(b.buffer);
+            std::vector<std::pair<uint64_t, uint64_t>>().swap(b.segments);
+        }
+
+        buffered_bytes_ = 0;
+        memory_usage_ = buckets_.capacity() * sizeof(Bucket);
+        if (spool)
+        {
+            spool.reset();
+            FileUtil::DeleteFile(fname_);
+        }
+
+        LOG(INFO) << "laid out " << os.size() << " bytes of " << buckets_.size() << " buckets, "
+                  << num_spills_ << " segments spilled";
+        return true;
+    }
+
+    // bytes of buffers and segment chains, kept up to date by each append
+    size_t memory_usage() const
+    {
+        return memory_usage_;
+    }
+
+private:
+    // spill the largest buffers until half of memory limit is left
+    void Spill()
+    {
+        if (!spool_)
+        {
+            spool_.reset(new FileOutputStream(fname_));
+        }
+
+        while (buffered_bytes_ > memory_limit_ / 2)
+        {
+            size_t largest = 0;
+            for (size_t i = 1;i < buckets_.size(); i++)
+            {
+                if (buckets_[i].buffer.length() > buckets_[largest].buffer.length())
+                    largest = i;
+            }
+
+            auto& b = buckets_[largest];
+            auto capacity = b.segments.capacity();
+            b.segments.push_back(std::make_pair(static_cast<uint64_t>(spool_->size()), static_cast<uint64_t>(b.buffer.length())));
+            memory_usage_ += (b.segments.capacity() - capacity) * sizeof(b.segments[0]);
+            spool_->Append(b.buffer);
+
+            buffered_bytes_ -= b.buffer.length();
+            memory_usage_ -= b.buffer.capacity();
+            std::string().swap(b.buffer);
+            num_spills_++;
+        }
+    }
+
+    struct Bucket
+    {
+        Bucket()
+            : length(0)
+        {}
+
+        std::string buffer; // tail not spilled yet
+        std::vector<std::pair<uint64_t, uint64_t>> segments; // (offset, length) in spool file
+        uint64_t length;
+    };
+
+    std::string fname_;
+    size_t memory_limit_;
+
+    std::vector<Bucket> buckets_;
+    size_t buffered_bytes_;
+    size_t memory_usage_;
+
+    boost::scoped_ptr<FileOutputStream> spool_;
+    int64_t num_spills_;
+};
+
+} // namespace
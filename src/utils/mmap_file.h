@@ -0,0 +1,58 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+#include "utils/file_util.h"
+
+namespace scdb {
+
+// Read only whole file mapping, used to revisit temp files when building
+class MmapFile : boost::noncopyable
+{
+public:
+    MmapFile(const std::string& fname)
+        : fd_(::open(fname.c_str(), O_RDONLY)),
+          size_(0),
+          ptr_(NULL)
+    {
+        if (fd_ < 0)
+            return ;
+
+        FileUtil::GetFileSize(fname, &size_);
+        if (size_ == 0)
+            return ;
+
+        auto mptr = ::mmap(NULL, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (mptr != MAP_FAILED)
+        {
+            ptr_ = reinterpret_cast<const char*>(mptr);
+            ::madvise(mptr, size_, MADV_SEQUENTIAL);
+        }
+    }
+
+    ~MmapFile()
+    {
+        if (ptr_)
+            ::munmap(const_cast<char*>(ptr_), size_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    bool valid() const { return ptr_ != NULL; }
+
+    const char* data() const { return ptr_; }
+    uint64_t size() const { return size_; }
+
+private:
+    int fd_;
+    uint64_t size_;
+    const char* ptr_;
+};
+
+} // namespace
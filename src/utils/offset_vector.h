@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+#include <stdexcept>
+
+namespace scdb {
+
+// 40 bits offsets kept as low 32 bits and high 8 bits, 5 bytes per offset,
+// used to stage offsets of values in a bucket up to 1 TiB
+class OffsetVector
+{
+public:
+    static const uint64_t kMaxOffset = (1ull << 40) - 1;
+
+    void push_back(uint64_t offset)
+    {
+        Check(offset);
+        lo_.push_back(static_cast<uint32_t>(offset));
+        hi_.push_back(static_cast<uint8_t>(offset >> 32));
+    }
+
+    void set(size_t i, uint64_t offset)
+    {
+        Check(offset);
+        lo_[i] = static_cast<uint32_t>(offset);
+        hi_[i] = static_cast<uint8_t>(offset >> 32);
+    }
+
+    uint64_t operator[](size_t i) const
+    {
+        return static_cast<uint64_t>(hi_[i]) << 32 | lo_[i];
+    }
+
+    size_t size() const { return lo_.size(); }
+
+    size_t memory_usage() const
+    {
+        return lo_.capacity() * sizeof(uint32_t) + hi_.capacity() * sizeof(uint8_t);
+    }
+
+    void clear()
+    {
+        std::vector<uint32_t>().swap(lo_);
+        std::vector<uint8_t>().swap(hi_);
+    }
+
+private:
+    static void Check(uint64_t offset)
+    {
+        if (offset > kMaxOffset)
+            throw std::overflow_error("offset " + std::to_string(offset) + " exceeds 40 bits");
+    }
+
+    std::vector<uint32_t> lo_;
+    std::vector<uint8_t> hi_;
+};
+
+} // namespace
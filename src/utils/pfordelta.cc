@@ -1,8 +1,7 @@
 #include "utils/pfordelta.h"
 
-#include <math.h>
-
 #include <fstream>
+#include <algorithm>
 
 #include <glog/logging.h>
 
@@ -12,12 +11,13 @@ namespace {
 
 const char* kTag = "PFDV1.";
 
+// number of bits to keep n, 0 for 0, exact for all 64 bits values
 uint32_t GetLgNum(uint64_t n)
 {
-    return 1 + log(n)/log(2);
+    return n ? 64 - __builtin_clzll(n) : 0;
 }
 
-uint32_t GetArraySize(uint64_t num, uint32_t bits)
+uint64_t GetArraySize(uint64_t num, uint32_t bits)
 {
     auto n = num*bits/64;
     if (n*64 < num*bits)
@@ -34,7 +34,7 @@ PForDelta::PForDelta(const std::vector<uint64_t>& v)
     min_ = max = v[0];
 
     std::vector<uint64_t> count_lg(65);
-    std::vector<uint64_t> min_lg(65, 0xffffffff);
+    std::vector<uint64_t> min_lg(65, ~0ull);
     std::vector<uint64_t> max_lg(65, 0);
     for (auto& num : v)
     {
@@ -44,7 +44,7 @@ PForDelta::PForDelta(const std::vector<uint64_t>& v)
         if (num > max)
             max = num;
 
-        auto lg = 1 + static_cast<uint32_t>(log(num)/log(2));
+        auto lg = std::max(GetLgNum(num), 1u); // 0 is counted with 1
         count_lg[lg]++;
 
         if (num < min_lg[lg])
@@ -78,8 +78,8 @@ PForDelta::PForDelta(const std::vector<uint64_t>& v)
         else
         {
             auto j = i + 2;
-            for (;count_lg[j]== 0; j++);
-            if (count_lg[j]) aux_min = min_lg[j];
+            for (;j <= max_bits_ && count_lg[j]== 0; j++);
+            if (j <= max_bits_) aux_min = min_lg[j];
         }
 
         auto y = max - aux_min;
@@ -103,7 +103,7 @@ PForDelta::PForDelta(const std::vector<uint64_t>& v)
 
             encoding = true;
 
-            extract_except_func_ = &PForDelta::ExtractExceptMax;
+            except_mode_ = kExceptMax;
         }
     }
 
@@ -127,7 +127,7 @@ PForDelta::PForDelta(const std::vector<uint64_t>& v)
         {
             int j = i - 2;
             for (;j >= static_cast<int>(min_bits_)&& count_lg[j]==0;j--);
-            if (j && count_lg[j])
+            if (j >= static_cast<int>(min_bits_))
                 aux_max = max_lg[j];
         }
 
@@ -152,7 +152,7 @@ PForDelta::PForDelta(const std::vector<uint64_t>& v)
 
             encoding = true;
 
-            extract_except_func_ = &PForDelta::ExtractExceptMin;
+            except_mode_ = kExceptMin;
         }
     }
 
@@ -172,7 +172,7 @@ PForDelta::PForDelta(const std::vector<uint64_t>& v)
             for(auto k = i; k <= j; k++)
                 count += count_lg[k];
 
-            auto count2 = 0;
+            uint64_t count2 = 0;
             for(auto k = min_bits_; k < i; k++)
                 count2 += count_lg[k];
 
@@ -182,7 +182,7 @@ PForDelta::PForDelta(const std::vector<uint64_t>& v)
             {
                 int m = i - 2;
                 for (;m >= static_cast<int>(min_bits_) && count_lg[m] == 0; m--);
-                if (m && count_lg[m])
+                if (m >= static_cast<int>(min_bits_))
                     aux_max = max_lg[m];
             }
 
@@ -200,7 +200,7 @@ PForDelta::PForDelta(const std::vector<uint64_t>& v)
             {
                 auto m = j + 2;
                 for (;m <= max_bits_ && count_lg[m]==0; m++);
-                if (count_lg[m])
+                if (m <= max_bits_)
                     aux_min = min_lg[m];
             }
 
@@ -224,7 +224,7 @@ PForDelta::PForDelta(const std::vector<uint64_t>& v)
                 bits_except_max_ = lgemax;
 
                 is_except_ = true;
-                extract_except_func_ = &PForDelta::ExtractExcept;
+                except_mode_ = kExceptBoth;
             }
         }
     }
@@ -337,6 +337,7 @@ PForDelta::PForDelta(const std::vector<uint64_t>& v)
         auto bv = sdsl::bit_vector(v.size(), 1);
         bas_p_ = min_;
         lim_p_ = max;
+        num_p_ = v.size();
         b_ = GetLgNum(lim_p_ - bas_p_);
 
         auto n = GetArraySize(num_p_, b_);
@@ -400,20 +401,6 @@ void PForDelta::SetNum64(uint64_t* A, uint64_t start, uint32_t length, uint64_t
     }
 }
 
-uint64_t PForDelta::GetNum64(uint64_t* A, uint64_t start, uint32_t length) const
-{
-    if (!length) return 0;
-
-    auto i = start >> 6u;
-    auto j = start - (i << 6u);
-    auto result = (A[i] << j) >> (64u - length);
-
-    if ((j + length) > 64u)
-        result = result | (A[i+1] >> (128u - j - length));
-
-    return result;
-}
-
 uint64_t PForDelta::ExtractExcept(uint64_t except_idx) const
 {
     auto n = except_rank_.rank(except_idx);
@@ -427,26 +414,6 @@ uint64_t PForDelta::ExtractExcept(uint64_t except_idx) const
     }
 }
 
-uint64_t PForDelta::ExtractExceptMin(uint64_t except_idx) const
-{
-    return min_+GetNum64(except_min_, (except_idx-1)*bits_except_min_, bits_except_min_);
-}
-
-uint64_t PForDelta::ExtractExceptMax(uint64_t except_idx) const
-{
-    return lim_p_+GetNum64(except_max_, (except_idx-1)*bits_except_max_, bits_except_max_);
-}
-
-uint64_t PForDelta::Extract(uint64_t idx) const
-{
-    auto r = bv_rank_(idx+1);
-    if (bv_rrr_[idx])
-    {
-        return bas_p_+GetNum64(p_, (r-1)*b_, b_);
-    }
-    return (this->*extract_except_func_)(idx+1-r);
-}
-
 void PForDelta::Save(const std::string& fname)
 {
     std::ofstream os(fname, std::ios::binary);
@@ -535,14 +502,14 @@ void PForDelta::Load(const std::string& fname, size_t offset)
 
     if (is_except_)
     {
-        extract_except_func_ = &PForDelta::ExtractExcept;
+        except_mode_ = kExceptBoth;
     }
     else
     {
         if (num_except_min_)
-            extract_except_func_ = &PForDelta::ExtractExceptMin;
+            except_mode_ = kExceptMin;
         else
-            extract_except_func_ = &PForDelta::ExtractExceptMax;
+            except_mode_ = kExceptMax;
     }
     auto n = GetArraySize(num_p_, b_);
     if (n)
@@ -25,7 +25,7 @@ public:
           min_bits_(0),
           max_bits_(0),
           min_(0),
-          extract_except_func_(NULL)
+          except_mode_(kExceptMax)
     {}
 
     PForDelta(const std::vector<uint64_t>& v);
@@ -35,7 +35,52 @@ public:
     void Save(const std::string& fname);
     void Load(const std::string& fname, size_t offset = 0);
 
-    uint64_t Extract(uint64_t i) const;
+    // Where the values out of [bas_p_, lim_p_) are kept
+    enum ExceptMode
+    {
+        kExceptMax = 0, // all above lim_p_
+        kExceptMin = 1, // all below bas_p_
+        kExceptBoth = 2, // on both sides, told apart by except_bv_
+    };
+
+    ExceptMode except_mode() const { return except_mode_; }
+
+    uint64_t Extract(uint64_t i) const
+    {
+        switch (except_mode_)
+        {
+            case kExceptMin:
+                return ExtractAs<kExceptMin>(i);
+            case kExceptBoth:
+                return ExtractAs<kExceptBoth>(i);
+            default:
+                return ExtractAs<kExceptMax>(i);
+        }
+    }
+
+    // Extract with the mode fixed at compile time, [kMode] must be
+    // except_mode(). Loops over many values pick it once outside
+    template <ExceptMode kMode>
+    uint64_t ExtractAs(uint64_t i) const
+    {
+        auto r = bv_rank_(i+1);
+        if (bv_rrr_[i])
+        {
+            return bas_p_+GetNum64(p_, (r-1)*b_, b_);
+        }
+
+        auto except_idx = i+1-r;
+        if (kMode == kExceptMin)
+        {
+            return min_+GetNum64(except_min_, (except_idx-1)*bits_except_min_, bits_except_min_);
+        }
+        else if (kMode == kExceptMax)
+        {
+            return lim_p_+GetNum64(except_max_, (except_idx-1)*bits_except_max_, bits_except_max_);
+        }
+        return ExtractExcept(except_idx);
+    }
+
     void Test(const std::vector<uint64_t>& v);
 
 private:
@@ -44,11 +89,21 @@ private:
     void SetNum64(uint64_t *A, uint64_t ini, uint32_t len, uint64_t x);
 
     // return (in a unsigned long integer) the number in A from bits of position 'ini' to 'ini+len-1'
-    uint64_t GetNum64(uint64_t *A, uint64_t ini, uint32_t len) const;
+    uint64_t GetNum64(const uint64_t *A, uint64_t ini, uint32_t len) const
+    {
+        if (!len) return 0;
+
+        auto i = ini >> 6u;
+        auto j = ini - (i << 6u);
+        auto result = (A[i] << j) >> (64u - len);
+
+        if ((j + len) > 64u)
+            result = result | (A[i+1] >> (128u - j - len));
+
+        return result;
+    }
 
     uint64_t ExtractExcept(uint64_t) const;
-    uint64_t ExtractExceptMin(uint64_t) const;
-    uint64_t ExtractExceptMax(uint64_t) const;
 
 private:
     sdsl::rrr_vector<127> bv_rrr_;
@@ -76,8 +131,7 @@ private:
     uint32_t max_bits_;
     uint64_t min_;
 
-    typedef uint64_t(PForDelta::*ExtractExceptFunc)(uint64_t) const;
-    ExtractExceptFunc extract_except_func_;
+    ExceptMode except_mode_;
 };
 
 } // namespace
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace scdb {
+
+// Peak resident set size of the process in bytes since its start, 0 if
+// /proc is not available. It is never reset here, as the peak belongs to
+// the whole process, not to a build in it
+inline int64_t PeakRss()
+{
+    FILE* fp = fopen("/proc/self/status", "re");
+    if (!fp)
+        return 0;
+
+    int64_t kb = 0;
+    char line[256];
+    while (fgets(line, sizeof line, fp))
+    {
+        if (strncmp(line, "VmHWM:", 6) == 0)
+        {
+            kb = strtoll(line + 6, NULL, 10);
+            break;
+        }
+    }
+    fclose(fp);
+    return kb << 10;
+}
+
+} // namespace
@@ -91,7 +91,9 @@ inline size_t EncodeVarint(uint64_t val, uint8_t* buf)
     return size_t(p - buf);
 }
 
-inline size_t EncodeVarint(uint64_t val, FileOutputStream* os)
+// [os] is a FileOutputStream or any stream with Append(const int8_t*, size_t)
+template<typename OutputStream>
+inline size_t EncodeVarint(uint64_t val, OutputStream* os)
 {
     uint8_t buf[10];
     auto size = EncodeVarint(val, buf);
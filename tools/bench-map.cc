@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "../include/scdb/scdb.h"
+
+#include "cmdopt.h"
+#include "input_loader.h"
+
+#include <glog/logging.h>
+
+namespace {
+
+void print_help(const char *cmd)
+{
+  std::cerr << "Usage: " << cmd << " [OPTION]...\n\n"
+      "Build the input once per codec and block size, then time random lookups of each file.\n\n"
+      "Options:\n"
+      "  -i, --input=[FILE]     read data from FILE, - for stdin\n"
+      "  -B, --binary-input     input is varint length prefixed key and value records instead of tsv\n"
+      "  -c, --codecs=[LIST]    comma separated of none,snappy,lz4,zstd,zstd-dict(default all)\n"
+      "  -b, --block-sizes=[LIST] comma separated block sizes, 0 for values compressed one by one(default 0,4096,16384,65536)\n"
+      "  -L, --compress-level=[N] compress level of zstd or lz4(lz4hc if > 0)\n"
+      "  -n, --lookups=[N]      random lookups timed per file(default 100000)\n"
+      "  -C, --block-cache=[N]  bytes of block cache of the reader(default 32M)\n"
+      "  -t, --tmpdir=[FILE]    tmp dir to store the files built\n"
+      "  -h, --help             print this help\n"
+      << std::endl;
+}
+
+struct Codec
+{
+    const char* name;
+    scdb::Writer::CompressType type;
+};
+
+const Codec kCodecs[] = {
+    { "none", scdb::Writer::kNone },
+    { "snappy", scdb::Writer::kSnappy },
+    { "lz4", scdb::Writer::kLZ4 },
+    { "zstd", scdb::Writer::kZstd },
+    { "zstd-dict", scdb::Writer::kZstdDict },
+};
+
+std::vector<std::string> split(const std::string& s)
+{
+    std::vector<std::string> items;
+    size_t begin = 0;
+    while (begin <= s.length())
+    {
+        auto end = s.find(',', begin);
+        if (end == std::string::npos)
+            end = s.length();
+        if (end > begin)
+            items.push_back(s.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return items;
+}
+
+int64_t nanos_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Build [keys] and [values] with [opt] to [output], then Get [lookups]
+// keys of them in random order, one line of results to stdout
+void bench(const std::vector<std::string>& keys, const std::vector<std::string>& values,
+           const std::vector<uint32_t>& lookups, const scdb::Writer::Option& opt,
+           const scdb::Reader::Option& reader_opt, const char* codec, const std::string& output)
+{
+    auto start = std::chrono::steady_clock::now();
+    scdb::Writer* writer = scdb::CreateWriter(opt, output);
+    for (size_t i = 0;i < keys.size(); i++)
+    {
+        writer->Put(keys[i], values[i]);
+    }
+    auto stats = writer->Close();
+    delete writer;
+    auto build_ns = nanos_since(start);
+
+    std::ifstream ifs(output, std::ios::binary | std::ios::ate);
+    int64_t file_bytes = ifs.tellg();
+
+    scdb::Reader* reader = scdb::CreateReader(reader_opt, output);
+    std::vector<int64_t> latency(lookups.size());
+    size_t value_bytes = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0;i < lookups.size(); i++)
+    {
+        auto t = std::chrono::steady_clock::now();
+        value_bytes += reader->Get(keys[lookups[i]]).length();
+        latency[i] = nanos_since(t);
+    }
+    auto get_ns = nanos_since(start);
+    delete reader;
+    ::unlink(output.c_str());
+
+    CHECK(!lookups.empty());
+    std::sort(latency.begin(), latency.end());
+    printf("%-10s %10zu %12ld %12ld %8.3f %10.1f %10ld %10ld %10ld %10zu\n",
+           codec, opt.block_size, static_cast<long>(stats.data_bytes), static_cast<long>(file_bytes),
+           stats.CompressionRatio(), build_ns / 1e6, static_cast<long>(get_ns / lookups.size()),
+           static_cast<long>(latency[latency.size() / 2]), static_cast<long>(latency[latency.size() * 99 / 100]),
+           value_bytes);
+    fflush(stdout);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    std::ios::sync_with_stdio(false);
+
+    ::cmdopt_option long_options[] = {
+        { "input", 1, NULL, 'i' },
+        { "binary-input", 0, NULL, 'B' },
+        { "codecs", 1, NULL, 'c' },
+        { "block-sizes", 1, NULL, 'b' },
+        { "compress-level", 1, NULL, 'L' },
+        { "lookups", 1, NULL, 'n' },
+        { "block-cache", 1, NULL, 'C' },
+        { "tmpdir", 1, NULL, 't' },
+        { "help", 0, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    ::cmdopt_t cmdopt;
+    ::cmdopt_init(&cmdopt, argc, argv, "i:Bc:b:L:n:C:t:h", long_options);
+
+    scdb::Writer::Option opt;
+    opt.build_type = scdb::Writer::kMap;
+
+    scdb::Reader::Option reader_opt;
+    scdb::InputLoader::Option input_opt;
+
+    std::string codecs = "none,snappy,lz4,zstd,zstd-dict";
+    std::string block_sizes = "0,4096,16384,65536";
+    size_t num_lookups = 100000;
+    char* input = NULL;
+
+    int label;
+    while ((label = ::cmdopt_get(&cmdopt)) != -1) {
+        switch (label) {
+            case 'i':
+            {
+                input = cmdopt.optarg;
+                break;
+            }
+            case 'B':
+            {
+                input_opt.format = scdb::InputLoader::kBinary;
+                break;
+            }
+            case 'c':
+            {
+                codecs = cmdopt.optarg;
+                break;
+            }
+            case 'b':
+            {
+                block_sizes = cmdopt.optarg;
+                break;
+            }
+            case 'L':
+            {
+                opt.compress_level = atoi(cmdopt.optarg);
+                break;
+            }
+            case 'n':
+            {
+                num_lookups = atol(cmdopt.optarg);
+                break;
+            }
+            case 'C':
+            {
+                reader_opt.block_cache_size = atol(cmdopt.optarg);
+                break;
+            }
+            case 't':
+            {
+                opt.temp_folder = cmdopt.optarg;
+                if (opt.temp_folder[opt.temp_folder.length()-1] != '/')
+                    opt.temp_folder.append("/");
+                break;
+            }
+            case 'h':
+            {
+                print_help(argv[0]);
+                return 0;
+            }
+            default:
+            {
+                return 1;
+            }
+        }
+    }
+
+    if (!input)
+    {
+        std::cerr << "no input!!!" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    scdb::InputLoader loader(input_opt);
+    loader.Load(input, [&](const scdb::StringPiece* k, const scdb::StringPiece* v, size_t n) {
+        for (size_t i = 0;i < n; i++)
+        {
+            keys.push_back(k[i].ToString());
+            values.push_back(v[i].ToString());
+        }
+    });
+    if (keys.empty())
+    {
+        std::cerr << "empty input!!!" << std::endl;
+        return 1;
+    }
+
+    // the same random keys for every file
+    std::mt19937 rng(20161);
+    std::vector<uint32_t> lookups(num_lookups);
+    for (auto& i : lookups)
+    {
+        i = rng() % keys.size();
+    }
+
+    printf("%-10s %10s %12s %12s %8s %10s %10s %10s %10s %10s\n",
+           "codec", "block", "data_bytes", "file_bytes", "ratio", "build_ms", "avg_ns", "p50_ns", "p99_ns", "got_bytes");
+
+    auto output = opt.temp_folder + "map-bench." + std::to_string(getpid());
+    for (auto& name : split(codecs))
+    {
+        const Codec* codec = NULL;
+        for (auto& c : kCodecs)
+        {
+            if (name == c.name)
+                codec = &c;
+        }
+        if (!codec)
+        {
+            std::cerr << "unknown codec " << name << std::endl;
+            return 1;
+        }
+
+        for (auto& size : split(block_sizes))
+        {
+            scdb::Writer::Option bench_opt(opt);
+            bench_opt.compress_type = codec->type;
+            bench_opt.block_size = atoi(size.c_str());
+            bench(keys, values, lookups, bench_opt, reader_opt, codec->name, output);
+        }
+    }
+    return 0;
+}
@@ -3,12 +3,11 @@
 #include <iostream>
 #include <string>
 
-#include <boost/algorithm/string.hpp>
-
 #include "../include/scdb/scdb.h"
 #include "../src/utils/timestamp.h"
 
 #include "cmdopt.h"
+#include "input_loader.h"
 
 #include <glog/logging.h>
 
@@ -20,8 +19,23 @@ void print_help(const char *cmd)
       "Options:\n"
       "  -c, --compress-snappy  build a dictionary with snappy compressed value(default not)\n"
       "  -d, --compress-dfa     build a dictionary with dfa compressed value(default not)\n"
+      "  -z, --compress-zstd-dict build a dictionary with zstd compressed value, use a trained dictionary(default not)\n"
+      "  -l, --compress-lz4     build a dictionary with lz4 compressed value(default not)\n"
+      "  -s, --compress-zstd    build a dictionary with zstd compressed value(default not)\n"
+      "  -I, --int-values       values are decimal uint64, kept in the index without data section\n"
+      "  -W, --value-width=[N]  every value is N bytes, -1 if all values have the same length, laid out without offset index\n"
+      "  -N, --inline-values=[N] keep values of at most N(<= 7) bytes in the offset index\n"
+      "  -L, --compress-level=[N] compress level of zstd or lz4(lz4hc if > 0)\n"
       "  -w, --with-checksum    build a dictionary with checksum\n"
-      "  -i, --input=[FILE]     read data to FILE\n"
+      "  -K, --key-order        keep keys in key order to count keys of a prefix fast\n"
+      "  -u, --dedup-values     store each distinct value only once\n"
+      "  -b, --block-size=[N]   compress values in blocks of about N bytes\n"
+      "  -S, --sorted-input     input is sorted by key, spill keys to tmpdir while putting, the build still loads them all\n"
+      "  -n, --num-shards=[N]   partition keys into N files built in parallel, output is their manifest\n"
+      "  -T, --trie-auto-tune   tune num tries and cache level of tries on a sample of keys\n"
+      "  -i, --input=[FILE]     read data from FILE, - for stdin\n"
+      "  -B, --binary-input     input is varint length prefixed key and value records instead of tsv\n"
+      "  -j, --threads=[N]      threads to parse tsv input(default 4)\n"
       "  -o, --output=[FILE]    write data to FILE\n"
       "  -t, --tmpdir=[FILE]    tmp dir to store tmp file \n"
       "  -f  --fulltest         fulltest after build\n"
@@ -29,7 +43,8 @@ void print_help(const char *cmd)
       << std::endl;
 }
 
-int build(const char* input, const char* output, const scdb::Writer::Option& opt, bool fulltest)
+int build(const char* input, const char* output, const scdb::Writer::Option& opt,
+          const scdb::InputLoader::Option& input_opt, bool fulltest)
 {
     if (!input)
     {
@@ -38,27 +53,38 @@ int build(const char* input, const char* output, const scdb::Writer::Option& opt
     }
 
     scdb::Timestamp start(scdb::Timestamp::Now());
-    scdb::Writer* writer = scdb::CreateWriter(opt, output);
+    scdb::Writer::Option option(opt);
+    option.progress = [](const scdb::BuildStats& stats) {
+        if (stats.phases.empty())
+            LOG(INFO) << stats.num_records << " records put";
+        else
+            LOG(INFO) << "phase " << stats.phases.back().name << " done";
+    };
+    scdb::Writer* writer = scdb::CreateWriter(option, output);
 
     std::vector<std::string> vt;
-    std::ifstream is(input);
-    while (!is.eof())
-    {
-        char buf[4096];
-        is.getline(buf, sizeof buf);
-        if (strlen(buf) == 0)
-            continue;
-
-        std::vector<std::string> v;
-        boost::algorithm::split(v, buf, boost::is_any_of("\t"));
-        writer->Put(v[0], v[1]);
-
+    scdb::InputLoader loader(input_opt);
+    auto n = loader.Load(input, [&](const scdb::StringPiece* keys, const scdb::StringPiece* values, size_t n) {
+        writer->PutBatch(keys, values, n);
         if (fulltest)
-            vt.push_back(v[0]);
-    }
-    writer->Close();
+        {
+            for (size_t i = 0;i < n; i++)
+                vt.push_back(keys[i].ToString());
+        }
+    });
+    LOG(INFO) << "Load " << n << " records use " << scdb::Timestamp::Now().MicroSecondsSinceEpoch() - start.MicroSecondsSinceEpoch() << " microseconds";
+
+    auto stats = writer->Close();
     delete writer;
     LOG(INFO) << "Build use " << scdb::Timestamp::Now().MicroSecondsSinceEpoch() - start.MicroSecondsSinceEpoch() << " microseconds";
+    LOG(INFO) << stats.num_records << " records, " << static_cast<int64_t>(stats.RecordsPerSecond()) << " records/s put, "
+              << stats.value_bytes << " value bytes in " << stats.data_bytes << " bytes data, ratio " << stats.CompressionRatio()
+              << ", peak staging " << stats.peak_staging_bytes << " bytes, " << static_cast<int64_t>(stats.StagingBytesPerRecord()) << " per record";
+    for (auto& phase : stats.phases)
+    {
+        LOG(INFO) << "  " << phase.name << ": " << phase.micros << " microseconds, "
+                  << phase.bytes << " bytes, peak rss " << phase.peak_rss << " (+" << phase.peak_rss_growth << ")";
+    }
 
     if (fulltest)
     {
@@ -71,6 +97,19 @@ int build(const char* input, const char* output, const scdb::Writer::Option& opt
             CHECK(exist) << "Unexpect result " << ti << " should in sets";
         }
         LOG(INFO) << "Full Test Pass!!! use " << scdb::Timestamp::Now().MicroSecondsSinceEpoch() - fs.MicroSecondsSinceEpoch() << " microseconds";
+
+        // Compression ratio vs latency of value lookup
+        scdb::Timestamp gs(scdb::Timestamp::Now());
+        size_t value_bytes = 0;
+        for (auto& ti : vt)
+        {
+            value_bytes += reader->GetAsString(ti).length();
+        }
+        auto get_us = scdb::Timestamp::Now().MicroSecondsSinceEpoch() - gs.MicroSecondsSinceEpoch();
+        std::ifstream ofs(output, std::ios::binary | std::ios::ate);
+        LOG(INFO) << "GetAsString " << vt.size() << " keys use " << get_us << " microseconds, "
+                  << value_bytes << " value bytes in " << ofs.tellg() << " bytes file";
+        delete reader;
     }
     return 0;
 }
@@ -84,8 +123,23 @@ int main(int argc, char *argv[])
     ::cmdopt_option long_options[] = {
         { "compress-snappy", 0, NULL, 'c' },
         { "compress-trie", 0, NULL, 'd' },
+        { "compress-zstd-dict", 0, NULL, 'z' },
+        { "compress-lz4", 0, NULL, 'l' },
+        { "compress-zstd", 0, NULL, 's' },
+        { "int-values", 0, NULL, 'I' },
+        { "value-width", 1, NULL, 'W' },
+        { "inline-values", 1, NULL, 'N' },
+        { "compress-level", 1, NULL, 'L' },
         { "with-checksum", 0, NULL, 'w' },
+        { "key-order", 0, NULL, 'K' },
+        { "dedup-values", 0, NULL, 'u' },
+        { "block-size", 1, NULL, 'b' },
+        { "sorted-input", 0, NULL, 'S' },
+        { "num-shards", 1, NULL, 'n' },
+        { "trie-auto-tune", 0, NULL, 'T' },
         { "input", 1, NULL, 'i'},
+        { "binary-input", 0, NULL, 'B' },
+        { "threads", 1, NULL, 'j' },
         { "output", 1, NULL, 'o' },
         { "tmpdir", 1, NULL, 't' },
         { "help", 0, NULL, 'h' },
@@ -93,12 +147,13 @@ int main(int argc, char *argv[])
         { NULL, 0, NULL, 0 }
     };
     ::cmdopt_t cmdopt;
-    ::cmdopt_init(&cmdopt, argc, argv, "fcdwi:o:t:h", long_options);
+    ::cmdopt_init(&cmdopt, argc, argv, "fcdzlsIW:N:L:wKub:Sn:Ti:Bj:o:t:h", long_options);
 
     scdb::Writer::Option opt;
     opt.build_type = scdb::Writer::kMap;
     opt.compress_type = scdb::Writer::kNone;
 
+    scdb::InputLoader::Option input_opt;
     bool fulltest = false;
 
     int label;
@@ -116,16 +171,91 @@ int main(int argc, char *argv[])
                 opt.compress_type = scdb::Writer::kDFA;
                 break;
             }
+            case 'z':
+            {
+                opt.compress_type = scdb::Writer::kZstdDict;
+                break;
+            }
+            case 'l':
+            {
+                opt.compress_type = scdb::Writer::kLZ4;
+                break;
+            }
+            case 's':
+            {
+                opt.compress_type = scdb::Writer::kZstd;
+                break;
+            }
+            case 'I':
+            {
+                opt.build_type = scdb::Writer::kIntMap;
+                break;
+            }
+            case 'W':
+            {
+                opt.value_width = atoi(cmdopt.optarg);
+                break;
+            }
+            case 'N':
+            {
+                opt.inline_value_bytes = atoi(cmdopt.optarg);
+                break;
+            }
+            case 'L':
+            {
+                opt.compress_level = atoi(cmdopt.optarg);
+                break;
+            }
             case 'w':
             {
                 opt.with_checksum = true;
                 break;
             }
+            case 'K':
+            {
+                opt.with_key_order = true;
+                break;
+            }
+            case 'u':
+            {
+                opt.dedup_values = true;
+                break;
+            }
+            case 'b':
+            {
+                opt.block_size = atoi(cmdopt.optarg);
+                break;
+            }
+            case 'S':
+            {
+                opt.sorted_input = true;
+                break;
+            }
+            case 'n':
+            {
+                opt.num_shards = atoi(cmdopt.optarg);
+                break;
+            }
+            case 'T':
+            {
+                opt.trie_auto_tune = true;
+                break;
+            }
             case 'i':
             {
                 input = cmdopt.optarg;
                 break;
             }
+            case 'B':
+            {
+                input_opt.format = scdb::InputLoader::kBinary;
+                break;
+            }
+            case 'j':
+            {
+                input_opt.num_threads = atoi(cmdopt.optarg);
+                break;
+            }
             case 'o': 
             {
                 output = cmdopt.optarg;
@@ -155,5 +285,5 @@ int main(int argc, char *argv[])
         }
     }
 
-    return build(input, output, opt, fulltest);
+    return build(input, output, opt, input_opt, fulltest);
 }
@@ -1,5 +1,4 @@
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
 #include <string>
 
@@ -7,6 +6,7 @@
 #include "../src/utils/timestamp.h"
 
 #include "cmdopt.h"
+#include "input_loader.h"
 
 #include <glog/logging.h>
 
@@ -17,7 +17,10 @@ void print_help(const char *cmd)
   std::cerr << "Usage: " << cmd << " [OPTION]... [FILE]...\n\n"
       "Options:\n"
       "  -w, --with-checksum    build a dictionary with checksum\n"
-      "  -i, --input=[FILE]     read data to FILE\n"
+      "  -K, --key-order        keep keys in key order to count keys of a prefix fast\n"
+      "  -i, --input=[FILE]     read data from FILE, - for stdin\n"
+      "  -B, --binary-input     input is varint length prefixed key records instead of lines\n"
+      "  -j, --threads=[N]      threads to parse line input(default 4)\n"
       "  -o, --output=[FILE]    write data to FILE\n"
       "  -t, --tmpdir=[FILE]    tmp dir to store tmp file \n"
       "  -f  --fulltest         fulltest after build\n"
@@ -25,7 +28,8 @@ void print_help(const char *cmd)
       << std::endl;
 }
 
-int build(const char* input, const char* output, const scdb::Writer::Option& opt, bool fulltest)
+int build(const char* input, const char* output, const scdb::Writer::Option& opt,
+          const scdb::InputLoader::Option& input_opt, bool fulltest)
 {
     if (!input)
     {
@@ -37,19 +41,15 @@ int build(const char* input, const char* output, const scdb::Writer::Option& opt
     scdb::Writer* writer = scdb::CreateWriter(opt, output);
 
     std::vector<std::string> vt;
-    std::ifstream is(input);
-    while (!is.eof())
-    {
-        char buf[4096];
-        is.getline(buf, sizeof buf);
-
-        if (strlen(buf) == 0)
-            continue;
-
-        writer->Put(buf);
+    scdb::InputLoader loader(input_opt);
+    loader.Load(input, [&](const scdb::StringPiece* keys, const scdb::StringPiece*, size_t n) {
+        writer->PutBatch(keys, NULL, n);
         if (fulltest)
-            vt.push_back(buf);
-    }
+        {
+            for (size_t i = 0;i < n; i++)
+                vt.push_back(keys[i].ToString());
+        }
+    });
     writer->Close();
     delete writer;
     LOG(INFO) << "Build use " << scdb::Timestamp::Now().MicroSecondsSinceEpoch() - start.MicroSecondsSinceEpoch() << " microseconds";
@@ -77,7 +77,10 @@ int main(int argc, char *argv[])
 
     ::cmdopt_option long_options[] = {
         { "with-checksum", 0, NULL, 'w' },
+        { "key-order", 0, NULL, 'K' },
         { "input", 1, NULL, 'i'},
+        { "binary-input", 0, NULL, 'B' },
+        { "threads", 1, NULL, 'j' },
         { "output", 1, NULL, 'o' },
         { "tmpdir", 1, NULL, 't' },
         { "help", 0, NULL, 'h' },
@@ -85,12 +88,14 @@ int main(int argc, char *argv[])
         { NULL, 0, NULL, 0 }
     };
     ::cmdopt_t cmdopt;
-    ::cmdopt_init(&cmdopt, argc, argv, "fwi:o:t:h", long_options);
+    ::cmdopt_init(&cmdopt, argc, argv, "fwKi:Bj:o:t:h", long_options);
 
     scdb::Writer::Option opt;
     opt.build_type = scdb::Writer::kSet;
     opt.compress_type = scdb::Writer::kNone;
 
+    scdb::InputLoader::Option input_opt;
+    input_opt.with_values = false;
     bool fulltest = false;
 
     int label;
@@ -103,11 +108,26 @@ int main(int argc, char *argv[])
                 opt.with_checksum = true;
                 break;
             }
+            case 'K':
+            {
+                opt.with_key_order = true;
+                break;
+            }
             case 'i':
             {
                 input = cmdopt.optarg;
                 break;
             }
+            case 'B':
+            {
+                input_opt.format = scdb::InputLoader::kBinary;
+                break;
+            }
+            case 'j':
+            {
+                input_opt.num_threads = atoi(cmdopt.optarg);
+                break;
+            }
             case 'o': 
             {
                 output = cmdopt.optarg;
@@ -137,5 +157,5 @@ int main(int argc, char *argv[])
         }
     }
 
-    return build(input, output, opt, fulltest);
+    return build(input, output, opt, input_opt, fulltest);
 }
@@ -0,0 +1,265 @@
+#include "input_loader.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include "../src/utils/mmap_file.h"
+
+namespace scdb {
+
+namespace {
+
+const size_t kChunkSize = 8 << 20;
+
+// Return false if [p, end) ends inside the varint
+bool ReadVarint(const char** p, const char* end, uint64_t* val)
+{
+    *val = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7)
+    {
+        uint8_t b = *(*p)++;
+        *val |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (b < 0x80)
+            return true;
+    }
+    return false;
+}
+
+} // namespace
+
+InputLoader::InputLoader(const Option& option)
+    : option_(option),
+      num_records_(0),
+      num_bad_lines_(0)
+{
+    if (option_.num_threads < 1)
+        option_.num_threads = 1;
+    if (option_.batch_size < 1)
+        option_.batch_size = 1;
+}
+
+InputLoader::~InputLoader()
+{
+}
+
+int64_t InputLoader::Load(const std::string& fname, const BatchFunc& func)
+{
+    num_records_ = 0;
+    num_bad_lines_ = 0;
+
+    if (fname == "-")
+    {
+        return LoadStream(stdin, func);
+    }
+
+    MmapFile file(fname);
+    if (!file.valid())
+    {
+        if (file.size() > 0 || !FileUtil::FileExists(fname))
+            throw std::runtime_error("can not read " + fname);
+        return 0; // empty file
+    }
+
+    if (option_.format == kBinary)
+    {
+        if (ParseBinary(file.data(), file.size(), func) != file.size())
+            throw std::runtime_error("truncated record at end of " + fname);
+    }
+    else
+    {
+        ParseTsv(file.data(), file.size(), func);
+    }
+
+    LOG_IF(WARNING, num_bad_lines_ > 0) << num_bad_lines_ << " lines without value skipped";
+    return num_records_;
+}
+
+// Read stdin in big blocks, an incomplete line or record at the end of a
+// block is moved to the front of the next one
+int64_t InputLoader::LoadStream(FILE* fp, const BatchFunc& func)
+{
+    std::string buf;
+    size_t length = 0;
+    size_t block_size = kChunkSize * option_.num_threads;
+    bool eof = false;
+    while (!eof)
+    {
+        if (buf.size() < length + block_size)
+            buf.resize(length + block_size);
+
+        auto n = fread(&buf[length], 1, buf.size() - length, fp);
+        if (n == 0)
+        {
+            if (ferror(fp))
+                throw std::runtime_error(std::string("read stdin failed: ") + strerror(errno));
+            eof = true;
+        }
+        length += n;
+
+        size_t consumed = 0;
+        if (option_.format == kBinary)
+        {
+            consumed = ParseBinary(buf.data(), length, func);
+            if (eof && consumed != length)
+                throw std::runtime_error("truncated record at end of stdin");
+        }
+        else
+        {
+            if (eof)
+            {
+                consumed = length;
+            }
+            else
+            {
+                auto p = static_cast<const char*>(memrchr(buf.data(), '\n', length));
+                consumed = p ? p - buf.data() + 1 : 0;
+            }
+            ParseTsv(buf.data(), consumed, func);
+        }
+
+        // records are delivered, the rest is kept for next read
+        buf.erase(0, consumed);
+        length -= consumed;
+    }
+
+    LOG_IF(WARNING, num_bad_lines_ > 0) << num_bad_lines_ << " lines without value skipped";
+    return num_records_;
+}
+
+// Chunks split at line ends are parsed in parallel, at most num_threads
+// ahead of the one being delivered, so records keep input order
+void InputLoader::ParseTsv(const char* data, size_t size, const BatchFunc& func)
+{
+    std::deque<std::future<std::unique_ptr<Chunk>>> pending;
+    size_t offset = 0;
+    while (offset < size || !pending.empty())
+    {
+        while (offset < size && pending.size() < static_cast<size_t>(option_.num_threads))
+        {
+            auto end = size;
+            if (size - offset > kChunkSize)
+            {
+                auto p = static_cast<const char*>(memchr(data + offset + kChunkSize, '\n', size - offset - kChunkSize));
+                end = p ? p - data + 1 : size;
+            }
+
+            auto begin = data + offset;
+            auto chunk_end = data + end;
+            pending.push_back(std::async(std::launch::async, [this, begin, chunk_end]() {
+                std::unique_ptr<Chunk> chunk(new Chunk());
+                ParseTsvChunk(begin, chunk_end, chunk.get());
+                return chunk;
+            }));
+            offset = end;
+        }
+
+        auto chunk = pending.front().get();
+        pending.pop_front();
+
+        num_bad_lines_ += chunk->num_bad_lines;
+        Deliver(*chunk, func);
+    }
+}
+
+void InputLoader::ParseTsvChunk(const char* begin, const char* end, Chunk* chunk) const
+{
+    auto p = begin;
+    while (p < end)
+    {
+        auto eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!eol)
+            eol = end;
+
+        auto line_end = eol;
+        if (line_end > p && line_end[-1] == '\r')
+            line_end--;
+
+        if (line_end > p)
+        {
+            if (!option_.with_values)
+            {
+                chunk->keys.push_back(StringPiece(p, line_end - p));
+            }
+            else
+            {
+                auto tab = static_cast<const char*>(memchr(p, '\t', line_end - p));
+                if (!tab)
+                {
+                    chunk->num_bad_lines++;
+                }
+                else
+                {
+                    auto value = tab + 1;
+                    auto value_end = static_cast<const char*>(memchr(value, '\t', line_end - value));
+                    if (!value_end)
+                        value_end = line_end;
+
+                    chunk->keys.push_back(StringPiece(p, tab - p));
+                    chunk->values.push_back(StringPiece(value, value_end - value));
+                }
+            }
+        }
+
+        p = eol + 1;
+    }
+}
+
+size_t InputLoader::ParseBinary(const char* data, size_t size, const BatchFunc& func)
+{
+    auto p = data;
+    auto end = data + size;
+    auto record = p;
+    while (p < end)
+    {
+        uint64_t key_length;
+        if (!ReadVarint(&p, end, &key_length) || key_length > static_cast<uint64_t>(end - p))
+            break;
+        StringPiece key(p, key_length);
+        p += key_length;
+
+        if (option_.with_values)
+        {
+            uint64_t value_length;
+            if (!ReadVarint(&p, end, &value_length) || value_length > static_cast<uint64_t>(end - p))
+                break;
+            batch_.values.push_back(StringPiece(p, value_length));
+            p += value_length;
+        }
+        batch_.keys.push_back(key);
+        record = p;
+
+        if (batch_.keys.size() == option_.batch_size)
+        {
+            Deliver(batch_, func);
+            batch_.keys.clear();
+            batch_.values.clear();
+        }
+    }
+
+    // records point into [data], deliver before it is reused
+    Deliver(batch_, func);
+    batch_.keys.clear();
+    batch_.values.clear();
+    return record - data;
+}
+
+void InputLoader::Deliver(const Chunk& chunk, const BatchFunc& func)
+{
+    auto values = option_.with_values ? chunk.values.data() : NULL;
+    for (size_t i = 0;i < chunk.keys.size(); i += option_.batch_size)
+    {
+        auto n = std::min(option_.batch_size, chunk.keys.size() - i);
+        func(chunk.keys.data() + i, values ? values + i : NULL, n);
+    }
+    num_records_ += chunk.keys.size();
+}
+
+} // namespace
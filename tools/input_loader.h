@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <boost/noncopyable.hpp>
+
+#include "../include/scdb/string_piece.h"
+
+namespace scdb {
+
+// Read records to build from a file or stdin and hand them out in batches,
+// in input order. Keys and values point into the mapped file or the read
+// buffer, no string is allocated per record.
+//
+// kTsv: a line is key\tvalue, the value ends at the next tab. A line is a
+//       key as a whole without values. Long lines are never truncated.
+//       Chunks of the input are parsed by num_threads threads.
+// kBinary: records of varint key length, key, varint value length, value.
+//       Without values a record is only the key.
+class InputLoader : boost::noncopyable
+{
+public:
+    enum Format
+    {
+        kTsv = 0,
+        kBinary = 1,
+    };
+
+    struct Option
+    {
+        Option()
+            : format(kTsv),
+              with_values(true),
+              num_threads(4),
+              batch_size(4096)
+        {}
+
+        Format format;
+        bool with_values; // false to load keys of a set
+        int num_threads; // threads to parse tsv
+        size_t batch_size; // max records of a batch
+    };
+
+    // [values] is NULL without values, records are valid only during the call
+    typedef std::function<void(const StringPiece* keys, const StringPiece* values, size_t n)> BatchFunc;
+
+    InputLoader(const Option& option);
+    ~InputLoader();
+
+    // [fname] "-" reads stdin. Return number of records loaded, throw
+    // std::runtime_error if the input can not be read or is truncated
+    int64_t Load(const std::string& fname, const BatchFunc& func);
+
+    // tsv lines without a tab when loading values, they are skipped
+    int64_t num_bad_lines() const { return num_bad_lines_; }
+
+private:
+    struct Chunk
+    {
+        Chunk()
+            : num_bad_lines(0)
+        {}
+
+        std::vector<StringPiece> keys;
+        std::vector<StringPiece> values;
+        int64_t num_bad_lines;
+    };
+
+    int64_t LoadStream(FILE* fp, const BatchFunc& func);
+
+    void ParseTsv(const char* data, size_t size, const BatchFunc& func);
+    void ParseTsvChunk(const char* begin, const char* end, Chunk* chunk) const;
+
+    // Return bytes of the complete records parsed
+    size_t ParseBinary(const char* data, size_t size, const BatchFunc& func);
+
+    void Deliver(const Chunk& chunk, const BatchFunc& func);
+
+    Option option_;
+    int64_t num_records_;
+    int64_t num_bad_lines_;
+    Chunk batch_; // records of binary input
+};
+
+} // namespace
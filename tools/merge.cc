@@ -0,0 +1,164 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../include/scdb/scdb.h"
+#include "../src/utils/timestamp.h"
+
+#include "cmdopt.h"
+
+#include <glog/logging.h>
+
+namespace {
+
+void print_help(const char *cmd)
+{
+  std::cerr << "Usage: " << cmd << " [OPTION]... FILE...\n\n"
+      "Merge dictionaries built by map-builder or set-builder into one.\n"
+      "Keys are streamed in order, from key order of an input built with it or from\n"
+      "sorted runs spilled to tmpdir; memory holds all keys once only while the key\n"
+      "trie of the output is built.\n\n"
+      "Options:\n"
+      "  -S, --set              inputs are sets\n"
+      "  -c, --compress-snappy  build a dictionary with snappy compressed value(default not)\n"
+      "  -z, --compress-zstd-dict build a dictionary with zstd compressed value, use a trained dictionary(default not)\n"
+      "  -l, --compress-lz4     build a dictionary with lz4 compressed value(default not)\n"
+      "  -s, --compress-zstd    build a dictionary with zstd compressed value(default not)\n"
+      "  -L, --compress-level=[N] compress level of zstd or lz4(lz4hc if > 0)\n"
+      "  -w, --with-checksum    build a dictionary with checksum\n"
+      "  -u, --dedup-values     store each distinct value only once\n"
+      "  -p, --policy=[first|last] which value is kept for a key in many files(default first)\n"
+      "  -o, --output=[FILE]    write data to FILE\n"
+      "  -t, --tmpdir=[FILE]    tmp dir to store tmp file \n"
+      "  -h, --help             print this help\n"
+      << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    std::ios::sync_with_stdio(false);
+
+    ::cmdopt_option long_options[] = {
+        { "set", 0, NULL, 'S' },
+        { "compress-snappy", 0, NULL, 'c' },
+        { "compress-zstd-dict", 0, NULL, 'z' },
+        { "compress-lz4", 0, NULL, 'l' },
+        { "compress-zstd", 0, NULL, 's' },
+        { "compress-level", 1, NULL, 'L' },
+        { "with-checksum", 0, NULL, 'w' },
+        { "dedup-values", 0, NULL, 'u' },
+        { "policy", 1, NULL, 'p' },
+        { "output", 1, NULL, 'o' },
+        { "tmpdir", 1, NULL, 't' },
+        { "help", 0, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    ::cmdopt_t cmdopt;
+    ::cmdopt_init(&cmdopt, argc, argv, "SczlsL:wup:o:t:h", long_options);
+
+    scdb::Writer::Option opt;
+    opt.build_type = scdb::Writer::kMap;
+    opt.compress_type = scdb::Writer::kNone;
+
+    scdb::MergePolicy policy = scdb::kFirstWins;
+
+    int label;
+    char* output = NULL;
+    while ((label = ::cmdopt_get(&cmdopt)) != -1) {
+        switch (label) {
+            case 'S':
+            {
+                opt.build_type = scdb::Writer::kSet;
+                break;
+            }
+            case 'c':
+            {
+                opt.compress_type = scdb::Writer::kSnappy;
+                break;
+            }
+            case 'z':
+            {
+                opt.compress_type = scdb::Writer::kZstdDict;
+                break;
+            }
+            case 'l':
+            {
+                opt.compress_type = scdb::Writer::kLZ4;
+                break;
+            }
+            case 's':
+            {
+                opt.compress_type = scdb::Writer::kZstd;
+                break;
+            }
+            case 'L':
+            {
+                opt.compress_level = atoi(cmdopt.optarg);
+                break;
+            }
+            case 'w':
+            {
+                opt.with_checksum = true;
+                break;
+            }
+            case 'u':
+            {
+                opt.dedup_values = true;
+                break;
+            }
+            case 'p':
+            {
+                if (strcmp(cmdopt.optarg, "first") == 0)
+                    policy = scdb::kFirstWins;
+                else if (strcmp(cmdopt.optarg, "last") == 0)
+                    policy = scdb::kLastWins;
+                else
+                {
+                    std::cerr << "unknown policy " << cmdopt.optarg << std::endl;
+                    return 1;
+                }
+                break;
+            }
+            case 'o':
+            {
+                output = cmdopt.optarg;
+                break;
+            }
+            case 't':
+            {
+                opt.temp_folder = cmdopt.optarg;
+                if (opt.temp_folder[opt.temp_folder.length()-1] != '/')
+                    opt.temp_folder.append("/");
+                break;
+            }
+            case 'h':
+            {
+                print_help(argv[0]);
+                return 0;
+            }
+            default:
+            {
+                return 1;
+            }
+        }
+    }
+
+    std::vector<std::string> inputs(cmdopt.argv + cmdopt.optind, cmdopt.argv + cmdopt.argc);
+    if (!output || inputs.empty())
+    {
+        print_help(argv[0]);
+        return 1;
+    }
+
+    scdb::Timestamp start(scdb::Timestamp::Now());
+    if (!scdb::Merge(opt, inputs, output, policy))
+    {
+        return 1;
+    }
+    LOG(INFO) << "Merge use " << scdb::Timestamp::Now().MicroSecondsSinceEpoch() - start.MicroSecondsSinceEpoch() << " microseconds";
+    return 0;
+}